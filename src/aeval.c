@@ -30,9 +30,43 @@ union val {
 
 // TODO: errout needs to be moved out of jobs.c
 #include "jobs.h"
+#include "debugger.h"
 
 #define ALT_(c)	((c)+0x80)
 
+/* The registers of the current job, which must be stopped.  They
+   come from its register cache, so naming one costs nothing after
+   the first in a stop. */
+static int stopped(void)
+{
+  if (!currjob || !currjob->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return 0;
+    }
+  if (currjob->state == 'r')
+    {
+      fputs(" job running? ", stderr);
+      return 0;
+    }
+  return 1;
+}
+
+/* A symbol of the current job, or failing that one of its
+   registers. */
+static char *evalname(char *expr, uint64_t *value)
+{
+  char *end = expr;
+
+  while (isalnum((unsigned char)*end) || *end == '_' || *end == '.')
+    end++;
+  if (job_symvalue(currjob, expr, end - expr, value))
+    return end;
+  if (!stopped() || !reg_value(currjob, expr, end - expr, value))
+    return NULL;
+  return end;
+}
+
 char *evalfactor(char *expr, uint64_t *value)
 {
   union val v;
@@ -67,6 +101,10 @@ char *evalfactor(char *expr, uint64_t *value)
 	  expr = end;
 	}
     }
+  else if (isalpha((unsigned char)*expr) || *expr == '_')
+    expr = evalname(expr, value);
+  else if ((unsigned char)*expr == ALT_('.'))
+    expr = stopped() && reg_value(currjob, "rip", 3, value) ? expr + 1 : NULL;
   else
     expr = NULL;
 
@@ -0,0 +1,767 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ptrace.h>
+#include <sys/reg.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "jobs.h"
+#include "debugger.h"
+#include "bpt.h"
+#include "x86.h"
+#include "cond.h"
+#include "record.h"
+#include "solib.h"
+
+/* Breakpoints.  Each job keeps its breakpoints in an open addressed
+   hash table keyed by address, so a trap is matched with one probe
+   however many are set.  The int3 stays in the job's memory while
+   the breakpoint is set; read_mem() shows the original bytes through
+   shadow_bpts(), and write_mem() deposits under it with cover_bpts().
+   cont_job() steps over a breakpoint at the pc.  Conditional
+   breakpoints and tracepoints are a jmp instead, see cond.c; the
+   int3 in a conditional one's trampoline is entered in the table
+   too, linked to it. */
+
+static unsigned hashof(uint64_t addr, unsigned size)
+{
+  return (addr * 0x9e3779b97f4a7c15ULL) >> 32 & (size - 1);
+}
+
+struct bpt *find_bpt(struct bpts *bs, uint64_t addr)
+{
+  if (!bs->used || addr < bs->lo || addr > bs->hi)
+    return NULL;
+  for (unsigned i = hashof(addr, bs->size);; i = (i + 1) & (bs->size - 1))
+    {
+      if (bs->t[i].addr == addr)
+	return &bs->t[i];
+      if (!bs->t[i].addr)
+	return NULL;
+    }
+}
+
+static struct bpt *insert(struct bpts *bs, uint64_t addr)
+{
+  unsigned i;
+
+  if ((bs->used + 1) * 2 > bs->size)
+    {
+      struct bpts old = *bs;
+      unsigned size = old.size ? old.size * 2 : 16;
+      if (!(bs->t = calloc(size, sizeof(struct bpt))))
+	{
+	  bs->t = old.t;
+	  return NULL;
+	}
+      bs->size = size;
+      for (unsigned k = 0; k < old.size; k++)
+	if (old.t[k].addr)
+	  {
+	    for (i = hashof(old.t[k].addr, size); bs->t[i].addr; i = (i + 1) & (size - 1))
+	      ;
+	    bs->t[i] = old.t[k];
+	  }
+      free(old.t);
+    }
+
+  for (i = hashof(addr, bs->size); bs->t[i].addr; i = (i + 1) & (bs->size - 1))
+    ;
+  if (!bs->used || addr < bs->lo)
+    bs->lo = addr;
+  if (!bs->used || addr > bs->hi)
+    bs->hi = addr;
+  bs->used++;
+  memset(&bs->t[i], 0, sizeof(struct bpt));
+  bs->t[i].addr = addr;
+  return &bs->t[i];
+}
+
+/* Backward shift deletion: pull later members of the probe run into
+   the hole so no tombstones are needed. */
+static void delete(struct bpts *bs, struct bpt *b)
+{
+  unsigned mask = bs->size - 1;
+  unsigned hole = b - bs->t;
+
+  for (unsigned i = (hole + 1) & mask; bs->t[i].addr; i = (i + 1) & mask)
+    {
+      unsigned home = hashof(bs->t[i].addr, bs->size);
+      if (((i - home) & mask) >= ((i - hole) & mask))
+	{
+	  bs->t[hole] = bs->t[i];
+	  hole = i;
+	}
+    }
+  bs->t[hole].addr = 0;
+  bs->used--;
+}
+
+void release_bpts(struct bpts *bs)
+{
+  for (unsigned k = 0; k < bs->size; k++)
+    if (bs->t[k].addr && (bs->t[k].flags & BPT_JMP))
+      free(bs->t[k].cond);
+  free(bs->t);
+  memset(bs, 0, sizeof(*bs));
+}
+
+/* Replace the int3s in buf, which holds len bytes from addr, by the
+   bytes they hide. */
+void shadow_bpts(struct bpts *bs, uint64_t addr, uint8_t *buf, size_t len)
+{
+  if (!bs->used || addr > bs->hi || addr + len <= bs->lo)
+    return;
+  if (len < bs->size)
+    {
+      for (size_t i = 0; i < len; i++)
+	{
+	  struct bpt *b = find_bpt(bs, addr + i);
+	  if (b)
+	    buf[i] = b->orig;
+	}
+    }
+  else
+    for (unsigned k = 0; k < bs->size; k++)
+      if (bs->t[k].addr >= addr && bs->t[k].addr - addr < len)
+	buf[bs->t[k].addr - addr] = bs->t[k].orig;
+
+  if (bs->njmp)
+    for (unsigned k = 0; k < bs->size; k++)
+      {
+	struct bpt *b = &bs->t[k];
+	if (!b->addr || !(b->flags & BPT_JMP)
+	    || b->addr >= addr + len || b->addr + b->len <= addr)
+	  continue;
+	for (int i = 0; i < b->len; i++)
+	  if (b->addr + i >= addr && b->addr + i < addr + len)
+	    buf[b->addr + i - addr] = b->code[i];
+      }
+}
+
+/* The reverse, for a deposit: the bytes of buf that land on a
+   breakpoint become its original bytes, and the int3 is kept.
+   Returns nonzero if buf was changed, -1 if it would write into the
+   jmp of a conditional breakpoint. */
+int cover_bpts(struct bpts *bs, uint64_t addr, uint8_t *buf, size_t len)
+{
+  int changed = 0;
+
+  if (!bs->used || addr > bs->hi || addr + len <= bs->lo)
+    return 0;
+  if (bs->njmp)
+    for (unsigned k = 0; k < bs->size; k++)
+      if (bs->t[k].addr && (bs->t[k].flags & BPT_JMP)
+	  && bs->t[k].addr < addr + len && bs->t[k].addr + bs->t[k].len > addr)
+	return -1;
+  for (size_t i = 0; i < len; i++)
+    {
+      struct bpt *b = find_bpt(bs, addr + i);
+      if (b)
+	{
+	  b->orig = buf[i];
+	  buf[i] = INT3;
+	  changed = 1;
+	}
+    }
+  return changed;
+}
+
+static struct bpt *numbered(struct bpts *bs, int n)
+{
+  for (unsigned k = 0; k < bs->size; k++)
+    if (bs->t[k].addr && bs->t[k].n == n)
+      return &bs->t[k];
+  return NULL;
+}
+
+/* Set breakpoint n, or the lowest free number if n is 0, at addr. */
+int set_bpt(struct job *j, uint64_t addr, int n, int flags)
+{
+  struct bpts *bs = &j->proc.bpts;
+  struct bpt *b;
+  uint8_t orig, int3 = INT3;
+
+  if ((b = find_bpt(bs, addr)))
+    {
+      if (n && n != b->n)
+	{
+	  clear_bptn(j, n);
+	  b = find_bpt(bs, addr);
+	  b->n = n;
+	}
+      b->flags = flags | (b->flags & (BPT_JMP | BPT_SOLIB));
+      return 1;
+    }
+  if (n)
+    clear_bptn(j, n);
+  else
+    for (n = 1; numbered(bs, n); n++)
+      ;
+
+  if (!read_mem(j, addr, &orig, 1) || !write_mem(j, addr, &int3, 1))
+    return 0;
+  if (!(b = insert(bs, addr)))
+    {
+      write_mem(j, addr, &orig, 1);
+      errno = ENOMEM;
+      return 0;
+    }
+  b->n = n;
+  b->flags = flags;
+  b->count = 1;
+  b->orig = orig;
+  return 1;
+}
+
+/* Take b out of the table and put back what it covered. */
+static int lift(struct job *j, struct bpt *b)
+{
+  struct bpts *bs = &j->proc.bpts;
+  uint64_t addr = b->addr;
+  uint8_t code[15];
+  int len = 1;
+
+  /* The dynamic linker's breakpoint outlives one set there by hand. */
+  if ((b->flags & BPT_SOLIB) && b->n)
+    {
+      if (bs->at == addr)
+	bs->at = 0;
+      b->n = 0;
+      b->flags = BPT_SOLIB;
+      b->count = 1;
+      return 1;
+    }
+  code[0] = b->orig;
+  if (b->flags & BPT_JMP)
+    {
+      struct bpt *s = b->link ? find_bpt(bs, b->link) : NULL;
+      len = b->len;
+      memcpy(code, b->code, len);
+      free(b->cond);
+      bs->njmp--;
+      if (s)
+	{
+	  delete(bs, s);
+	  b = find_bpt(bs, addr);
+	}
+    }
+  if (bs->at == addr)
+    bs->at = 0;
+  delete(bs, b);
+  return write_mem(j, addr, code, len);
+}
+
+int clear_bpt(struct job *j, uint64_t addr)
+{
+  struct bpt *b = find_bpt(&j->proc.bpts, addr);
+
+  if (!b)
+    {
+      errno = ENOENT;
+      return 0;
+    }
+  return lift(j, b);
+}
+
+int clear_bptn(struct job *j, int n)
+{
+  struct bpt *b = numbered(&j->proc.bpts, n);
+
+  if (!b)
+    {
+      errno = ENOENT;
+      return 0;
+    }
+  return lift(j, b);
+}
+
+/* The one-shot breakpoint of $^N and $$^N: stop at addr, but only
+   once the stack is back at sp or above, so recursive calls returning
+   to addr do not stop the job. */
+int set_tbpt(struct job *j, uint64_t addr, uint64_t sp)
+{
+  struct bpts *bs = &j->proc.bpts;
+  struct bpt *b;
+
+  clear_tbpt(j);
+  if ((b = find_bpt(bs, addr)) && (b->flags & BPT_JMP))
+    {
+      errno = EBUSY;
+      return 0;
+    }
+  if (!b)
+    {
+      uint8_t orig, int3 = INT3;
+      if (!read_mem(j, addr, &orig, 1) || !write_mem(j, addr, &int3, 1))
+	return 0;
+      if (!(b = insert(bs, addr)))
+	{
+	  write_mem(j, addr, &orig, 1);
+	  errno = ENOMEM;
+	  return 0;
+	}
+      b->flags = BPT_TEMP;
+      b->orig = orig;
+    }
+  bs->temp = addr;
+  bs->tempsp = sp;
+  return 1;
+}
+
+int clear_tbpt(struct job *j)
+{
+  struct bpts *bs = &j->proc.bpts;
+  struct bpt *b = find_bpt(bs, bs->temp);
+
+  bs->temp = 0;
+  if (b && (b->flags & BPT_TEMP))
+    return lift(j, b);
+  return 1;
+}
+
+/* The unnumbered breakpoint through which solib.c hears of objects
+   being loaded and unloaded. */
+int set_sbpt(struct job *j, uint64_t addr)
+{
+  struct bpts *bs = &j->proc.bpts;
+  struct bpt *b;
+  uint8_t orig, int3 = INT3;
+
+  if ((b = find_bpt(bs, addr)))
+    {
+      if (b->flags & BPT_JMP)
+	{
+	  errno = EBUSY;
+	  return 0;
+	}
+      b->flags |= BPT_SOLIB;
+      return 1;
+    }
+  if (!read_mem(j, addr, &orig, 1) || !write_mem(j, addr, &int3, 1))
+    return 0;
+  if (!(b = insert(bs, addr)))
+    {
+      write_mem(j, addr, &orig, 1);
+      errno = ENOMEM;
+      return 0;
+    }
+  b->flags = BPT_SOLIB;
+  b->orig = orig;
+  return 1;
+}
+
+int clear_bpts(struct job *j)
+{
+  struct bpts *bs = &j->proc.bpts;
+  int ok = 1;
+
+  for (unsigned k = 0; k < bs->size; k++)
+    if (bs->t[k].addr)
+      {
+	struct bpt *b = &bs->t[k];
+	uint64_t addr = b->addr;
+	b->addr = 0;
+	bs->used--;
+	if (b->flags & BPT_JMP)
+	  {
+	    ok &= write_mem(j, addr, b->code, b->len);
+	    free(b->cond);
+	  }
+	else if (!(b->flags & BPT_STUB))
+	  ok &= write_mem(j, addr, &b->orig, 1);
+      }
+  bs->at = bs->temp = 0;
+  bs->njmp = 0;
+  return ok;
+}
+
+#define TRAMPPAGE 4096
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+#define NEAR (((uint64_t)1 << 31) - TRAMPPAGE)
+
+/* Find room for n bytes of trampoline within a rel32 jmp of addr,
+   mapping a new page in the job when the current one is full or too
+   far.  The page goes in the nearest hole in the job's maps; a
+   kernel before 4.17 takes the address only as a hint, so a page it
+   puts elsewhere is unmapped again. */
+uint64_t tramp_space(struct job *j, uint64_t addr, size_t n)
+{
+  struct bpts *bs = &j->proc.bpts;
+  struct regions *rs;
+  uint64_t best = 0, bestd = NEAR;
+  long got;
+
+  if (bs->tramp && bs->tramp + n <= bs->trampend
+      && bs->tramp - addr + NEAR < 2 * NEAR)
+    goto out;
+  if (!(rs = job_regions(j)))
+    return 0;
+  for (int i = 0; i + 1 < rs->n; i++)
+    {
+      uint64_t lo = rs->r[i].end, hi = rs->r[i + 1].start;
+      uint64_t a = addr < lo ? lo : hi - TRAMPPAGE;
+      uint64_t d = a > addr ? a - addr : addr - a;
+      if (hi - lo >= TRAMPPAGE && d < bestd)
+	{
+	  best = a;
+	  bestd = d;
+	}
+    }
+  if (!best)
+    {
+      errno = ENOMEM;
+      return 0;
+    }
+  got = remote_syscall(j, SYS_mmap, best, TRAMPPAGE,
+		       PROT_READ | PROT_WRITE | PROT_EXEC,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (got != best)
+    {
+      if (got > 0 || got < -4095)
+	remote_syscall(j, SYS_munmap, got, TRAMPPAGE, 0, 0, 0, 0);
+      errno = got < 0 && got > -4096 ? -got : EEXIST;
+      return 0;
+    }
+  bs->tramp = best;
+  bs->trampend = best + TRAMPPAGE;
+
+ out:
+  bs->tramp += n;
+  return bs->tramp - n;
+}
+
+/* Put conditional breakpoint b back to an int3. */
+static int uncond(struct job *j, struct bpt *b)
+{
+  struct bpts *bs = &j->proc.bpts;
+  uint64_t addr = b->addr;
+  struct bpt *s;
+  uint8_t code[15];
+
+  code[0] = INT3;
+  memcpy(code + 1, b->code + 1, b->len - 1);
+  if (!patch_mem(j, addr, code, b->len))
+    return 0;
+  free(b->cond);
+  if ((s = find_bpt(bs, b->link)))
+    delete(bs, s);
+  b = find_bpt(bs, addr);
+  b->flags &= ~BPT_COND;
+  bs->njmp--;
+  return 1;
+}
+
+/* Replace the int3 of b by a jmp to a trampoline running body, made
+   by build_tramp(), and the instructions the jmp displaces; no other
+   breakpoint may be among them, and the dynamic linker's must stay
+   an int3.  flags is BPT_COND or BPT_TRACE; a conditional
+   trampoline's int3 goes in the table too. */
+static int jmp_patch(struct job *j, struct bpt *b, const uint8_t *body,
+		     size_t nbody, int flags)
+{
+  struct bpts *bs = &j->proc.bpts;
+  struct bpt *s = NULL;
+  uint8_t tramp[2048], insns[32], jmp[15];
+  uint64_t addr = b->addr, base, stub = 0;
+  uint64_t *stubp = flags & BPT_COND ? &stub : NULL;
+  size_t len, size;
+  struct user_regs_struct *regs;
+  struct insn in;
+
+  if (b->flags & BPT_SOLIB)
+    {
+      errno = EBUSY;
+      return 0;
+    }
+  if (!read_mem(j, addr, insns, sizeof(insns)))
+    return 0;
+  for (len = 0; len < 5; len += in.len)
+    if (!insn_decode(insns + len, sizeof(insns) - len, &in)
+	|| len + in.len > sizeof(b->code))
+      {
+	errno = ENOEXEC;
+	return 0;
+      }
+  for (size_t i = 1; i < len; i++)
+    if (find_bpt(bs, addr + i))
+      {
+	errno = EBUSY;
+	return 0;
+      }
+  /* Stopped after the first of the displaced instructions, the job
+     would go on in the middle of the jmp. */
+  if ((regs = job_regs(j)) && regs->rip > addr && regs->rip < addr + len)
+    {
+      errno = EAGAIN;
+      return 0;
+    }
+
+  /* Assemble once to learn the size, then again where it goes. */
+  if (!(size = build_tramp(tramp, sizeof(tramp), addr, addr, insns, len,
+			   body, nbody, stubp))
+      || !(base = tramp_space(j, addr, size)))
+    {
+      if (!size)
+	errno = ENOEXEC;
+      return 0;
+    }
+  if (!build_tramp(tramp, sizeof(tramp), base, addr, insns, len,
+		   body, nbody, stubp))
+    {
+      errno = ENOEXEC;
+      goto fail;
+    }
+
+  int32_t rel = base - (addr + 5);
+  jmp[0] = 0xe9;
+  memcpy(jmp + 1, &rel, 4);
+  memset(jmp + 5, INT3, len - 5);
+  if (!patch_mem(j, base, tramp, size))
+    goto fail;
+  if (stubp)
+    {
+      if (!(s = insert(bs, stub)))
+	{
+	  errno = ENOMEM;
+	  goto fail;
+	}
+      s->n = 0;
+      s->flags = BPT_STUB;
+      s->link = addr;
+      s->orig = INT3;
+    }
+  if (!patch_mem(j, addr, jmp, len))
+    {
+      if (s)
+	delete(bs, s);
+      goto fail;
+    }
+
+  b = find_bpt(bs, addr);
+  b->flags |= flags;
+  b->link = stub;
+  b->len = len;
+  memcpy(b->code, insns, len);
+  bs->njmp++;
+  if (addr + len - 1 > bs->hi)
+    bs->hi = addr + len - 1;
+  return 1;
+
+ fail:
+  /* Give back the space if nothing has been taken after it. */
+  if (bs->tramp == base + size)
+    bs->tramp = base;
+  return 0;
+}
+
+/* :cond <n> <expr> makes breakpoint n stop the job only when expr,
+   computed by the job itself in a trampoline (see cond.c), is
+   nonzero.  An empty expr makes the breakpoint unconditional again. */
+int set_cond(struct job *j, int n, const char *expr)
+{
+  struct bpts *bs = &j->proc.bpts;
+  struct bpt *b;
+  uint8_t code[512];
+  size_t ncode;
+  uint64_t addr;
+
+  if (!(b = numbered(bs, n)))
+    {
+      errno = ENOENT;
+      return 0;
+    }
+  if (b->flags & BPT_TRACE)
+    {
+      errno = EBUSY;
+      return 0;
+    }
+  if ((b->flags & BPT_COND) && !uncond(j, b))
+    return 0;
+  if (!*expr)
+    return 1;
+  addr = b->addr;
+  if (!(ncode = compile_cond(expr, code, sizeof(code), addr)))
+    {
+      errno = EINVAL;
+      return 0;
+    }
+  if (!jmp_patch(j, b, code, ncode, BPT_COND))
+    return 0;
+  find_bpt(bs, addr)->cond = strdup(expr);
+  return 1;
+}
+
+/* Make a tracepoint at addr logging exprs, which are separated by
+   commas, to the ring at ring in the job.  It takes the lowest free
+   breakpoint number, which is returned, or 0. */
+int set_tpoint(struct job *j, uint64_t addr, const char *exprs, uint64_t ring)
+{
+  struct bpts *bs = &j->proc.bpts;
+  struct bpt *b;
+  uint8_t code[1024];
+  size_t ncode;
+  int n;
+
+  if (find_bpt(bs, addr))
+    {
+      errno = EBUSY;
+      return 0;
+    }
+  if (!set_bpt(j, addr, 0, 0))
+    return 0;
+  b = find_bpt(bs, addr);
+  n = b->n;
+  if (!(ncode = compile_trace(exprs, code, sizeof(code), addr, ring, n)))
+    {
+      clear_bpt(j, addr);
+      errno = EINVAL;
+      return 0;
+    }
+  if (!jmp_patch(j, b, code, ncode, BPT_TRACE))
+    {
+      int e = errno;
+      clear_bpt(j, addr);
+      errno = e;
+      return 0;
+    }
+  find_bpt(bs, addr)->cond = strdup(exprs);
+  return n;
+}
+
+void cond_bpt(char *arg)
+{
+  struct job *j = currjob;
+  char *end;
+  long n;
+
+  if (!j || !j->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  if (j->state == 'r')
+    {
+      fputs(" job running? ", stderr);
+      return;
+    }
+  n = strtol(arg, &end, 10);
+  if (end == arg || n <= 0)
+    {
+      fputs(" breakpoint number? ", stderr);
+      return;
+    }
+  while (*end == ' ')
+    end++;
+  if (set_cond(j, n, end))
+    return;
+  if (errno == ENOENT)
+    fputs(" no such breakpoint? ", stderr);
+  else if (errno == EINVAL)
+    fputs(" bad condition? ", stderr);
+  else if (errno == ENOEXEC)
+    fputs(" can't move the code there? ", stderr);
+  else if (errno == EBUSY)
+    fputs(" another breakpoint in the way? ", stderr);
+  else if (errno == EAGAIN)
+    fputs(" job stopped in the code to be moved? ", stderr);
+  else
+    errout("cond");
+}
+
+/* The job has stopped at b, with the pc already backed up to it.
+   Returns nonzero if it should stay stopped, having typed where;
+   zero to let it run on.  A $^N stop is typed like a ^N one. */
+int bpt_hit(struct job *j, struct bpt *b)
+{
+  struct bpts *bs = &j->proc.bpts;
+
+  if (b->flags & BPT_SOLIB)
+    solib_hit(j);
+  if (b->addr == bs->temp)
+    {
+      struct user_regs_struct *regs = job_regs(j);
+      if (regs && regs->rsp >= bs->tempsp)
+	{
+	  int user = !(b->flags & BPT_TEMP);
+	  clear_tbpt(j);
+	  typeout_pc(j);
+	  fputs("\r\n", stderr);
+	  if (user)
+	    bs->at = b->addr;
+	  return 1;
+	}
+    }
+  if (!b->n)
+    return 0;
+
+  b->hits++;
+  record_bpt(j, b->addr, b->n);
+  if (b->count > 1)
+    {
+      b->count--;
+      return 0;
+    }
+  fprintf(stderr, "$%dB; ", b->n);
+  typeout_pc(j);
+  fputs("\r\n", stderr);
+  if (b->flags & BPT_AUTO)
+    return 0;
+  bs->at = b->addr;
+  return 1;
+}
+
+void listb(char *unused)
+{
+  struct bpts *bs;
+
+  if (!currjob)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  bs = &currjob->proc.bpts;
+  int left = 0;
+  for (unsigned k = 0; k < bs->size; k++)
+    if (bs->t[k].addr && bs->t[k].n)
+      left++;
+  fputs("\r\n", stderr);
+  for (int n = 1; left; n++)
+    {
+      struct bpt *b = numbered(bs, n);
+      if (!b)
+	continue;
+      fprintf(stderr, "$%dB\t%lx\t%lu hits%s", n, b->addr, b->hits,
+	      b->flags & BPT_AUTO ? ", auto" : "");
+      if (b->count > 1)
+	fprintf(stderr, ", proceed %ld", b->count);
+      if (b->flags & BPT_COND)
+	fprintf(stderr, ", if %s", b->cond);
+      if (b->flags & BPT_TRACE)
+	fprintf(stderr, ", trace %s", b->cond);
+      fputs("\r\n", stderr);
+      left--;
+    }
+}
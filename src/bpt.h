@@ -0,0 +1,38 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define INT3 0xcc
+
+struct bpt *find_bpt(struct bpts *bs, uint64_t addr);
+void shadow_bpts(struct bpts *bs, uint64_t addr, uint8_t *buf, size_t len);
+int cover_bpts(struct bpts *bs, uint64_t addr, uint8_t *buf, size_t len);
+void release_bpts(struct bpts *bs);
+
+int set_bpt(struct job *j, uint64_t addr, int n, int flags);
+int clear_bpt(struct job *j, uint64_t addr);
+int clear_bptn(struct job *j, int n);
+int clear_bpts(struct job *j);
+int set_tbpt(struct job *j, uint64_t addr, uint64_t sp);
+int clear_tbpt(struct job *j);
+int set_sbpt(struct job *j, uint64_t addr);
+uint64_t tramp_space(struct job *j, uint64_t addr, size_t n);
+int set_cond(struct job *j, int n, const char *expr);
+int set_tpoint(struct job *j, uint64_t addr, const char *exprs, uint64_t ring);
+int bpt_hit(struct job *j, struct bpt *b);
+void cond_bpt(char *);
+void listb(char *);
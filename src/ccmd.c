@@ -25,6 +25,15 @@ along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
 #include "user.h"
 #include "term.h"
 #include "debugger.h"
+#include "dump.h"
+#include "snap.h"
+#include "profile.h"
+#include "perf.h"
+#include "raid.h"
+#include "bpt.h"
+#include "tpoint.h"
+#include "record.h"
+#include "strace.h"
 
 void help(char *);
 void list_builtins(char *);
@@ -57,7 +66,9 @@ struct builtin builtins[] =
   {
    {"clear", "", "clear screen [^L]", clear},
    {"chuname", "<new uname>", "change user name (log out and in again)", chuname},
+   {"cond", "<n> <expr>", "stop at breakpoint <n> only when <expr> is nonzero", cond_bpt},
    {"continue", "", "continue program, giving job TTY [$p]", contin},
+   {"counters", "<reset|stop (opt)>", "count cycles, instructions etc. of the job, or type the counts", counters},
    {"cwd", "<dir>", "change working directory [$$^s]", cwd},
    {"ddtmode", "", "leave MONIT mode", set_ddtmode},
    {"delete", "<file>", "delete file [^o]", delete_file},
@@ -74,6 +85,7 @@ struct builtin builtins[] =
    {"lfile", "", "print filename of last file loaded", lfile},
    {"listp", "", "list block struct of the job's symbol table", listp},
    {"listf", "<dir>", "list files [^f]", listf},
+   {"listb", "", "list breakpoints of current job", listb},
    {"listj", "", "list jobs [$$v]", listj},
    {"lists", "", "list job's symbols", lists},
    {"load", "<file>", "load file into core [$l]", load_prog},
@@ -85,16 +97,26 @@ struct builtin builtins[] =
    {"nfdir", "<dir1>,<dir2>...", "add file directories to search list", nfdir},
    {"ofdir", "<dir1>,<dir2>...", "remove file directories from search list", ofdir},
    {"outtest", "", "perform actions normally associated with logging out", outtest},
+   {"pdump", "<file>", "write current job as an ELF core file, leaving it alive", pdump},
    {"print", "<file>", "print file [^r]", print_file},
    {"proced", "", "same as proceed", proced},
    {"proceed", "", "proceed job, leave tty to DDT [$p]", proced},
+   {"profile", "<secs> <hz> <file (opt)>", "sample the running job, type a flat profile, write folded stacks to <file>", profile},
+   {"raidflush", "", "turn off all raid registers of the current job", raidflush},
+   {"record", "<file (opt)>", "record steps, breakpoints, signals and syscalls of the job to <file>, or stop", record},
    {"retry", "<prgm> <opt jcl>", "invoke <prgm>, clobbering any old copy", retry},
+   {"sample", "<secs> <hz> <file (opt)>", "like :profile, with perf events, never stopping the job", sample},
+   {"sdiff", "", "type words changed since :snap", sdiff},
    {"self", "", "select DDT as current job", self},
    {"sl", "<file>", "same as :symlod (load symbols only, don't clobber core)", symlod},
    {"slist", "", "same as :lists", lists},
+   {"snap", "", "snapshot writable memory when current job next runs", snap},
    {"sstatus", "", "type system status", sstatus_},
    {"start", "<start addr (opt)>", "start inferior [<addr>$g]", go},
+   {"strace", "<syscalls>", "type the job's calls of <syscalls>, filtered by seccomp; none stops", strace},
    {"symlod", "<file>", "load symbols only (don't clobber core)", symlod},
+   {"tpoint", "<addr> <exprs> (opt)", "log exprs at <addr> without stopping, or type the log", tpoint},
+   {"trace", "<n (opt)>", "type the last <n> instructions stepped", trace},
    {"version", "", "type version number of Linux and DDT", version_},
    {"?", "", "list all : commands", list_builtins},
    {0, 0, 0, 0}
@@ -0,0 +1,434 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "x86.h"
+#include "jobs.h"
+#include "cond.h"
+#include "tpoint.h"
+
+/* Conditional breakpoints are not tested by DDT but by the job
+   itself.  The condition, an expression in the syntax of aeval.c
+   whose operands may also be register names, is compiled to x86
+   code and put in a trampoline page in the job, together with the
+   instructions the breakpoint displaces.  The breakpoint becomes a
+   jmp to the trampoline, which only reaches its int3 when the
+   condition is nonzero.
+
+   The compiled expression leaves its value in rax, using the stack
+   for partial results, and may clobber rcx and rdx; the trampoline
+   saves those three and the flags below the red zone first:
+
+	lea -128(%rsp),%rsp
+	pushf; push %rax; push %rcx; push %rdx
+	<condition>
+	test %rax,%rax
+	pop %rdx; pop %rcx; pop %rax
+	jnz 1f
+	popf; lea 128(%rsp),%rsp
+	jmp 2f
+   1:	popf; lea 128(%rsp),%rsp
+	int3
+   2:	<displaced instructions>
+	jmp <breakpoint>+<displaced length>
+
+   A tracepoint's trampoline is the same without the test and int3;
+   its code stores the values of its expressions in a ring shared
+   with DDT, see tpoint.c.  @ in an expression fetches the word at
+   the address that follows; a bad address faults in the job. */
+
+#define REDZONE 128
+#define SAVED 4			/* words pushed: flags, rax, rcx, rdx */
+
+struct code {
+  uint8_t *p;
+  size_t n;
+  size_t max;
+  int depth;			/* words pushed by the expression */
+  uint64_t pc;
+};
+
+static void emit(struct code *c, const void *bytes, size_t n)
+{
+  if (c->n + n <= c->max)
+    memcpy(c->p + c->n, bytes, n);
+  c->n += n;
+}
+
+static void emit32(struct code *c, uint32_t v)
+{
+  emit(c, &v, 4);
+}
+
+static void emit64(struct code *c, uint64_t v)
+{
+  emit(c, &v, 8);
+}
+
+static const char *regnames[16] = {
+  "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+  "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+
+/* Load register r as it was at the breakpoint into rax. */
+static void loadreg(struct code *c, int r)
+{
+  /* Offsets of the saved words from rsp with nothing else pushed. */
+  static const int8_t saved[4] = { 16, 8, 0, -1 };
+  uint32_t base = 8 * c->depth;
+
+  if (r < 3)
+    {
+      emit(c, "\x48\x8b\x84\x24", 4);	/* mov disp32(%rsp),%rax */
+      emit32(c, base + saved[r]);
+    }
+  else if (r == 4)
+    {
+      emit(c, "\x48\x8d\x84\x24", 4);	/* lea disp32(%rsp),%rax */
+      emit32(c, base + 8 * SAVED + REDZONE);
+    }
+  else
+    {
+      uint8_t mov[3] = { 0x48 | (r >= 8 ? 4 : 0), 0x89, 0xc0 | (r & 7) << 3 };
+      emit(c, mov, 3);			/* mov %r,%rax */
+    }
+}
+
+static const char *cexpr(struct code *c, const char *s);
+
+static const char *cfactor(struct code *c, const char *s)
+{
+  if (*s == '-')
+    {
+      if (!(s = cexpr(c, s + 1)))
+	return NULL;
+      emit(c, "\x48\xf7\xd8", 3);	/* neg %rax */
+    }
+  else if (*s == '@')
+    {
+      if (!(s = cfactor(c, s + 1)))
+	return NULL;
+      emit(c, "\x48\x8b\x00", 3);	/* mov (%rax),%rax */
+    }
+  else if (isdigit((unsigned char)*s))
+    {
+      char *end;
+      uint64_t v = strtoull(s, &end, 0);
+      emit(c, "\x48\xb8", 2);		/* mov $imm64,%rax */
+      emit64(c, v);
+      s = end;
+    }
+  else if (isalpha((unsigned char)*s))
+    {
+      size_t len = 0;
+      int r;
+      while (isalnum((unsigned char)s[len]))
+	len++;
+      for (r = 0; r < 16; r++)
+	if (strlen(regnames[r]) == len && !strncmp(s, regnames[r], len))
+	  break;
+      if (r < 16)
+	loadreg(c, r);
+      else if (len == 3 && !strncmp(s, "rip", 3))
+	{
+	  emit(c, "\x48\xb8", 2);
+	  emit64(c, c->pc);
+	}
+      else if (len == 5 && !strncmp(s, "flags", 5))
+	{
+	  emit(c, "\x48\x8b\x84\x24", 4);
+	  emit32(c, 8 * c->depth + 24);
+	}
+      else
+	return NULL;
+      s += len;
+    }
+  else
+    return NULL;
+  return s;
+}
+
+/* Save rax, compile the right operand, and leave the left in rax
+   and the right in rcx. */
+static const char *operand(struct code *c, const char *s,
+			   const char *(*f)(struct code *, const char *))
+{
+  emit(c, "\x50", 1);			/* push %rax */
+  c->depth++;
+  if (!(s = f(c, s)))
+    return NULL;
+  emit(c, "\x48\x89\xc1\x58", 4);	/* mov %rax,%rcx; pop %rax */
+  c->depth--;
+  return s;
+}
+
+static const char *clogic(struct code *c, const char *s)
+{
+  if (!(s = cfactor(c, s)))
+    return NULL;
+  for (;;)
+    {
+      const char *op;
+      switch (*s)
+	{
+	case '#':
+	  op = "\x48\x31\xc8";		/* xor %rcx,%rax */
+	  break;
+	case '&':
+	  op = "\x48\x21\xc8";		/* and %rcx,%rax */
+	  break;
+	case '|':
+	  op = "\x48\x09\xc8";		/* or %rcx,%rax */
+	  break;
+	default:
+	  return s;
+	}
+      if (!(s = operand(c, s + 1, cfactor)))
+	return NULL;
+      emit(c, op, 3);
+    }
+}
+
+static const char *cterm(struct code *c, const char *s)
+{
+  if (!(s = clogic(c, s)))
+    return NULL;
+  for (;;)
+    {
+      char op = *s;
+      if (op != '*' && op != '!')
+	return s;
+      if (!(s = operand(c, s + 1, clogic)))
+	return NULL;
+      if (op == '*')
+	emit(c, "\x48\x0f\xaf\xc1", 4);	/* imul %rcx,%rax */
+      else				/* test %rcx,%rcx; jz 1f; */
+	emit(c, "\x48\x85\xc9\x74\x05\x31\xd2\x48\xf7\xf1", 10);
+    }					/* xor %edx,%edx; div %rcx; 1: */
+}
+
+static const char *cexpr(struct code *c, const char *s)
+{
+  if (!(s = cterm(c, s)))
+    return NULL;
+  for (;;)
+    {
+      char op = *s;
+      if (op != '+' && op != '-')
+	return s;
+      if (!(s = operand(c, s + 1, cterm)))
+	return NULL;
+      emit(c, op == '+' ? "\x48\x01\xc8" : "\x48\x29\xc8", 3);
+    }
+}
+
+/* An expression, or two compared with =, <>, < or > (unsigned),
+   giving 1 or 0. */
+static const char *crel(struct code *c, const char *s)
+{
+  uint8_t setcc;
+
+  if (!(s = cexpr(c, s)))
+    return NULL;
+  if (s[0] == '<' && s[1] == '>')
+    setcc = 0x95, s += 2;
+  else if (*s == '=')
+    setcc = 0x94, s++;
+  else if (*s == '<')
+    setcc = 0x92, s++;
+  else if (*s == '>')
+    setcc = 0x97, s++;
+  else
+    return s;
+  if (!(s = operand(c, s, cexpr)))
+    return NULL;
+  uint8_t cmp[9] = { 0x48, 0x39, 0xc8, 0x0f, setcc, 0xc0, 0x0f, 0xb6, 0xc0 };
+  emit(c, cmp, sizeof(cmp));		/* cmp; setcc %al; movzbl %al,%eax */
+  return s;
+}
+
+/* Compile expr for a breakpoint at pc.  Returns the length of the
+   code, or 0 if expr does not parse or the code does not fit. */
+size_t compile_cond(const char *expr, uint8_t *buf, size_t max, uint64_t pc)
+{
+  struct code c = { buf, 0, max, 0, pc };
+  const char *s = crel(&c, expr);
+
+  if (!s || *s || c.n > max)
+    return 0;
+  return c.n;
+}
+
+/* Compile the comma separated exprs for tracepoint n at pc.  Their
+   values go on the stack, then into the next slot of the ring at
+   ring, see tpoint.h; the slot's sequence word is zeroed first and
+   stored last so DDT can tell a slot being filled.  Returns the length of the code, or 0
+   if an expr does not parse, there are more than TP_VALS, or the
+   code does not fit. */
+size_t compile_trace(const char *exprs, uint8_t *buf, size_t max,
+		     uint64_t pc, uint64_t ring, int n)
+{
+  struct code c = { buf, 0, max, 0, pc };
+  const char *s = exprs;
+  int k = 0, nv;
+
+  while (*s)
+    {
+      if (k == TP_VALS || !(s = crel(&c, s)))
+	return 0;
+      emit(&c, "\x50", 1);			/* push %rax */
+      c.depth++;
+      k++;
+      if (*s == ',')
+	s++;
+      else if (*s)
+	return 0;
+      while (*s == ' ')
+	s++;
+    }
+  nv = k;
+
+  emit(&c, "\x48\xba", 2);			/* mov $ring,%rdx */
+  emit64(&c, ring);
+  emit(&c, "\xb9\x01\x00\x00\x00", 5);	/* mov $1,%ecx */
+  emit(&c, "\xf0\x48\x0f\xc1\x0a", 5);	/* lock xadd %rcx,(%rdx) */
+  emit(&c, "\x48\x89\xc8\x25", 4);		/* mov %rcx,%rax; and $mask,%eax */
+  emit32(&c, TP_SLOTS - 1);
+  emit(&c, "\x48\xc1\xe0\x06", 4);		/* shl $6,%rax */
+  emit(&c, "\x48\x8d\x94\x02", 4);		/* lea TP_HEAD(%rdx,%rax),%rdx */
+  emit32(&c, TP_HEAD);
+  emit(&c, "\x48\xc7\x02\x00\x00\x00\x00", 7); /* movq $0,(%rdx) */
+  while (k--)
+    {
+      uint8_t pop[5] = { 0x58, 0x48, 0x89, 0x42, 16 + 8 * k };
+      emit(&c, pop, sizeof(pop));		/* pop %rax; mov %rax,v[k](%rdx) */
+    }
+  emit(&c, "\x48\xc7\x42\x08", 4);		/* movq $n,8(%rdx) */
+  emit32(&c, n | nv << 24);
+  emit(&c, "\x48\xff\xc1\x48\x89\x0a", 6);	/* inc %rcx; mov %rcx,(%rdx) */
+  return c.n <= max ? c.n : 0;
+}
+
+/* Copy the instruction in, which was at from, to buf, which will be
+   at to, fixing up anything relative to the pc.  Returns the new
+   length, 0 if it cannot be moved. */
+static size_t relocate(uint8_t *buf, const uint8_t *p, struct insn *in,
+		       uint64_t from, uint64_t to)
+{
+  int64_t d;
+  int32_t v;
+
+  if (in->rel >= 0 && in->relsize == 1)
+    {
+      /* Short branches become near ones. */
+      uint64_t target = from + in->len + (int8_t)p[in->rel];
+      size_t n;
+      if (in->rel != 1)
+	return 0;
+      if (p[0] == 0xeb)
+	{
+	  buf[0] = 0xe9;
+	  n = 5;
+	}
+      else if (p[0] >= 0x70 && p[0] <= 0x7f)
+	{
+	  buf[0] = 0x0f;
+	  buf[1] = 0x80 | (p[0] & 0xf);
+	  n = 6;
+	}
+      else
+	return 0;			/* loop, jrcxz */
+      d = target - (to + n);
+      if (d != (int32_t)d)
+	return 0;
+      v = d;
+      memcpy(buf + n - 4, &v, 4);
+      return n;
+    }
+
+  memcpy(buf, p, in->len);
+  if (in->rel >= 0 || in->disp >= 0)
+    {
+      int off = in->rel >= 0 ? in->rel : in->disp;
+      memcpy(&v, p + off, 4);
+      d = from + v - to;
+      if (d != (int32_t)d)
+	return 0;
+      v = d;
+      memcpy(buf + off, &v, 4);
+    }
+  return in->len;
+}
+
+static void jmp32(struct code *c, uint64_t target)
+{
+  emit(c, "\xe9", 1);
+  emit32(c, target - (c->pc + c->n + 4));
+}
+
+/* Assemble the trampoline for a breakpoint at home into buf, to be
+   put at base.  code holds the len bytes displaced from home.
+   Returns the size and sets *stub to the address of the int3, or
+   returns 0 if the code cannot be moved.  Without stub it is a
+   tracepoint's: cond is run for its effect, with no test or int3. */
+size_t build_tramp(uint8_t *buf, size_t max, uint64_t base, uint64_t home,
+		   const uint8_t *code, size_t len,
+		   const uint8_t *cond, size_t ncond, uint64_t *stub)
+{
+  static const uint8_t restore[9] = {
+    0x9d, 0x48, 0x8d, 0xa4, 0x24, REDZONE, 0, 0, 0	/* popf; lea */
+  };
+  struct code c = { buf, 0, max, 0, base };
+
+  emit(&c, "\x48\x8d\x64\x24\x80", 5);	/* lea -128(%rsp),%rsp */
+  emit(&c, "\x9c\x50\x51\x52", 4);	/* pushf; push rax, rcx, rdx */
+  emit(&c, cond, ncond);
+  if (stub)
+    {
+      emit(&c, "\x48\x85\xc0", 3);		/* test %rax,%rax */
+      emit(&c, "\x5a\x59\x58", 3);		/* pop rdx, rcx, rax */
+      emit(&c, "\x75\x0b", 2);		/* jnz 1f */
+      emit(&c, restore, sizeof(restore));
+      emit(&c, "\xeb\x0a", 2);		/* jmp 2f */
+      emit(&c, restore, sizeof(restore));	/* 1: */
+      *stub = base + c.n;
+      emit(&c, "\xcc", 1);			/* int3 */
+    }
+  else
+    {
+      emit(&c, "\x5a\x59\x58", 3);		/* pop rdx, rcx, rax */
+      emit(&c, restore, sizeof(restore));
+    }
+
+  for (size_t off = 0; off < len; )	/* 2: */
+    {
+      struct insn in;
+      uint8_t moved[16];
+      size_t n;
+      if (!insn_decode(code + off, len - off, &in)
+	  || !(n = relocate(moved, code + off, &in, home + off, base + c.n)))
+	return 0;
+      emit(&c, moved, n);
+      off += in.len;
+    }
+  jmp32(&c, home + len);
+  return c.n <= max ? c.n : 0;
+}
@@ -0,0 +1,24 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+size_t compile_cond(const char *expr, uint8_t *buf, size_t max, uint64_t pc);
+size_t compile_trace(const char *exprs, uint8_t *buf, size_t max,
+		     uint64_t pc, uint64_t ring, int n);
+size_t build_tramp(uint8_t *buf, size_t max, uint64_t base, uint64_t home,
+		   const uint8_t *code, size_t len,
+		   const uint8_t *cond, size_t ncond, uint64_t *stub);
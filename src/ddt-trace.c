@@ -0,0 +1,252 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tracefile.h"
+
+/* ddt-trace [-d] <file> decodes a DDT :record trace file.  It types
+   a summary: the events of each type, the pcs stepped most often,
+   breakpoint hits, signals, and time spent in each system call.
+   With -d it types every event first. */
+
+#define TOPPCS 20
+
+static const char *evnames[EV_MAX + 1] = {
+  "?", "step", "bpt", "signal", "syscall", "sysret", "exit"
+};
+
+static const int nargs[EV_MAX + 1] = { 0, 0, 1, 1, 7, 2, 1 };
+
+struct pccount {
+  uint64_t pc;
+  uint64_t n;
+};
+
+static struct pccount *pcs;
+static size_t npcs, pcsize;
+
+static void countpc(uint64_t pc)
+{
+  if ((npcs + 1) * 2 > pcsize)
+    {
+      struct pccount *old = pcs;
+      size_t oldsize = pcsize;
+      pcsize = pcsize ? pcsize * 2 : 4096;
+      if (!(pcs = calloc(pcsize, sizeof(struct pccount))))
+	{
+	  perror("ddt-trace");
+	  exit(1);
+	}
+      for (size_t i = 0; i < oldsize; i++)
+	if (old[i].n)
+	  {
+	    size_t k = (old[i].pc * 0x9e3779b97f4a7c15ULL) >> 32 & (pcsize - 1);
+	    while (pcs[k].n)
+	      k = (k + 1) & (pcsize - 1);
+	    pcs[k] = old[i];
+	  }
+      free(old);
+    }
+
+  size_t k = (pc * 0x9e3779b97f4a7c15ULL) >> 32 & (pcsize - 1);
+  while (pcs[k].n && pcs[k].pc != pc)
+    k = (k + 1) & (pcsize - 1);
+  if (!pcs[k].n)
+    {
+      pcs[k].pc = pc;
+      npcs++;
+    }
+  pcs[k].n++;
+}
+
+static int bycount(const void *a, const void *b)
+{
+  const struct pccount *x = a, *y = b;
+  return x->n < y->n ? 1 : x->n > y->n ? -1 : 0;
+}
+
+static const uint8_t *get(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+  int shift = 0;
+
+  *v = 0;
+  while (p < end && shift < 64)
+    {
+      *v |= (uint64_t)(*p & 0x7f) << shift;
+      if (!(*p++ & 0x80))
+	return p;
+      shift += 7;
+    }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t counts[EV_MAX + 1] = { 0 };
+  uint64_t bpts[256] = { 0 }, sigs[65] = { 0 };
+  uint64_t sysn[512] = { 0 }, systime[512] = { 0 };
+  uint64_t t = 0, pc = 0, v, n;
+  int dump = 0, opt;
+  struct stat st;
+  int fd;
+
+  while ((opt = getopt(argc, argv, "d")) != -1)
+    if (opt == 'd')
+      dump = 1;
+    else
+      goto usage;
+  if (optind != argc - 1)
+    {
+    usage:
+      fprintf(stderr, "usage: ddt-trace [-d] <file>\n");
+      return 2;
+    }
+
+  if ((fd = open(argv[optind], O_RDONLY)) == -1 || fstat(fd, &st) == -1)
+    {
+      perror(argv[optind]);
+      return 1;
+    }
+  const uint8_t *base = NULL;
+  if (st.st_size >= sizeof(struct tracehdr)
+      && (base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    base = NULL;
+  const struct tracehdr *hdr = (const void *)base;
+  if (!hdr || memcmp(hdr->magic, TRACE_MAGIC, 8) || hdr->version != TRACE_VERSION)
+    {
+      fprintf(stderr, "%s: not a DDT trace file\n", argv[optind]);
+      return 1;
+    }
+  madvise((void *)base, st.st_size, MADV_SEQUENTIAL);
+
+  const uint8_t *p = base + sizeof(struct tracehdr);
+  const uint8_t *end = base + st.st_size;
+  while (p < end)
+    {
+      int type = *p++;
+      uint64_t a[8];
+      int na = 0;
+
+      if (type < 1 || type > EV_MAX || !(p = get(p, end, &v)))
+	{
+	  fprintf(stderr, "bad event at %ld\n", (long)(p ? p - base - 1 : -1));
+	  break;
+	}
+      t += v;
+      if (type <= EV_SYSCALL)
+	{
+	  if (!(p = get(p, end, &v)))
+	    break;
+	  pc += unzigzag(v);
+	}
+      int want = nargs[type];
+      while (na < want && (p = get(p, end, &a[na])))
+	na++;
+      if (na < want)
+	break;
+      counts[type]++;
+
+      switch (type)
+	{
+	case EV_STEP:
+	  countpc(pc);
+	  break;
+	case EV_BPT:
+	  bpts[a[0] & 255]++;
+	  break;
+	case EV_SIGNAL:
+	  if (a[0] < 65)
+	    sigs[a[0]]++;
+	  break;
+	case EV_SYSRET:
+	  if (a[0] < 512)
+	    {
+	      sysn[a[0]]++;
+	      systime[a[0]] += v;
+	    }
+	  break;
+	}
+
+      if (!dump)
+	continue;
+      printf("%14.6f %-7s", t / 1e9, evnames[type]);
+      if (type <= EV_SYSCALL)
+	printf(" %lx", pc);
+      switch (type)
+	{
+	case EV_BPT:
+	  printf(" $%luB", a[0]);
+	  break;
+	case EV_SIGNAL:
+	  printf(" %lu %s", a[0], a[0] < 65 ? strsignal(a[0]) : "");
+	  break;
+	case EV_SYSCALL:
+	  printf(" %lu(%lx, %lx, %lx, %lx, %lx, %lx)",
+		 a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+	  break;
+	case EV_SYSRET:
+	  printf(" %lu = %ld", a[0], unzigzag(a[1]));
+	  break;
+	case EV_EXIT:
+	  printf(" status %lx", a[0]);
+	  break;
+	}
+      putchar('\n');
+    }
+
+  n = 0;
+  for (int i = 1; i <= EV_MAX; i++)
+    n += counts[i];
+  printf("pid %u, %lu events in %.6f s, %lu bytes (%.2f per event)\n",
+	 hdr->pid, n, t / 1e9, (unsigned long)st.st_size,
+	 n ? (double)(st.st_size - sizeof(struct tracehdr)) / n : 0.0);
+  for (int i = 1; i <= EV_MAX; i++)
+    if (counts[i])
+      printf("  %-8s %lu\n", evnames[i], counts[i]);
+
+  if (npcs)
+    {
+      size_t k = 0;
+      for (size_t i = 0; i < pcsize; i++)
+	if (pcs[i].n)
+	  pcs[k++] = pcs[i];
+      qsort(pcs, k, sizeof(struct pccount), bycount);
+      printf("%lu pcs stepped, most often:\n", npcs);
+      for (size_t i = 0; i < k && i < TOPPCS; i++)
+	printf("  %16lx %lu\n", pcs[i].pc, pcs[i].n);
+    }
+  for (int i = 0; i < 256; i++)
+    if (bpts[i])
+      printf("$%dB hit %lu times\n", i, bpts[i]);
+  for (int i = 1; i < 65; i++)
+    if (sigs[i])
+      printf("signal %d (%s) %lu times\n", i, strsignal(i), sigs[i]);
+  for (int i = 0; i < 512; i++)
+    if (sysn[i])
+      printf("syscall %d: %lu calls, %.6f s\n", i, sysn[i], systime[i] / 1e9);
+  return 0;
+}
@@ -21,6 +21,7 @@ along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
 #include <stdint.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/ptrace.h>
@@ -33,10 +34,20 @@ along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <ctype.h>
-#include <signal.h>
-#include <setjmp.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <stddef.h>
 #include "jobs.h"
 #include "debugger.h"
+#include "snap.h"
+#include "bpt.h"
+#include "x86.h"
+#include "record.h"
+#include "strace.h"
+#include "elffile.h"
+#include "symbols.h"
+#include "solib.h"
 
 uint64_t qreg = 0;
 
@@ -57,66 +68,1286 @@ static void crlf(void)
   fputs("\r\n", stderr);
 }
 
-void step_job(struct job *j)
+/* Region index.  A sorted copy of /proc/pid/maps, parsed again only
+   once the job has run since the last time. */
+
+static void clear_regions(struct regions *rs)
 {
-  int status;
-  if (ptrace(PTRACE_SINGLESTEP, j->proc.pid, NULL, NULL) == -1)
-    errout("ptrace");
-  check_jobs();
+  for (int i = 0; i < rs->n; i++)
+    free(rs->r[i].name);
+  rs->n = 0;
+  rs->valid = 0;
 }
 
-void pushdot(pid_t pid, uint64_t value)
+void release_regions(struct regions *rs)
 {
-  dr_end = ++dr_end % DOTRING_SIZE;
+  clear_regions(rs);
+  free(rs->r);
+  rs->r = NULL;
+  rs->max = 0;
+}
 
-  dotring[dr_end].pid = pid;
-  dotring[dr_end].addr = value;
+static int parse_maps(pid_t pid, struct regions *rs)
+{
+  char path[32];
+  char *line = NULL;
+  size_t len = 0;
+  FILE *maps;
 
-  if (dr_end == dr_start)
-    dr_start = ++dr_start % DOTRING_SIZE;
+  clear_regions(rs);
+
+  snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+  if ((maps = fopen(path, "re")) == NULL)
+    return 0;
+
+  while (getline(&line, &len, maps) != -1)
+    {
+      struct region r = { 0 };
+      char prot[5];
+      int name = 0;
+
+      if (sscanf(line, "%lx-%lx %4s %lx %*x:%*x %lu %n",
+		 &r.start, &r.end, prot, &r.offset, &r.inode, &name) < 5)
+	continue;
+
+      r.prot = (prot[0] == 'r' ? PROT_READ : 0)
+	| (prot[1] == 'w' ? PROT_WRITE : 0)
+	| (prot[2] == 'x' ? PROT_EXEC : 0)
+	| (prot[3] == 's' ? REGION_SHARED : 0);
+      if (name && line[name] && line[name] != '\n')
+	{
+	  line[strcspn(line, "\n")] = 0;
+	  r.name = strdup(line + name);
+	}
+
+      if (rs->n == rs->max)
+	{
+	  int max = rs->max ? 2 * rs->max : 64;
+	  struct region *p = realloc(rs->r, max * sizeof(struct region));
+	  if (!p)
+	    {
+	      free(r.name);
+	      break;
+	    }
+	  rs->r = p;
+	  rs->max = max;
+	}
+      rs->r[rs->n++] = r;
+    }
+  free(line);
+  fclose(maps);
+
+  rs->valid = 1;
+  return 1;
+}
+
+/* DDT's own index has no run count to go by; it is parsed again
+   when an address misses it, or when refresh_regions() says so. */
+static struct regions selfregions;
+
+static int selfp(struct job *j)
+{
+  return !j || !j->proc.pid;
 }
 
-sigjmp_buf point;
+void refresh_regions(struct job *j)
+{
+  if (selfp(j))
+    selfregions.valid = 0;
+  else
+    j->proc.regions.valid = 0;
+}
 
-static void segvhandler(int sig, siginfo_t *ign1, void *ign2)
+struct regions *job_regions(struct job *j)
 {
-  longjmp(point, 1);
+  if (selfp(j))
+    {
+      if (!selfregions.valid && !parse_maps(getpid(), &selfregions))
+	return NULL;
+      return &selfregions;
+    }
+
+  struct regions *rs = &j->proc.regions;
+
+  if (!rs->valid || rs->runs != j->proc.runs || j->state == 'r')
+    {
+      if (!parse_maps(j->proc.pid, rs))
+	return NULL;
+      rs->runs = j->proc.runs;
+    }
+  return rs;
 }
 
-int openlocation(pid_t pid, uint64_t addr)
+struct region *find_region(struct regions *rs, uint64_t addr)
 {
+  int lo = 0, hi = rs->n;
+
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (addr < rs->r[mid].start)
+	hi = mid;
+      else if (addr >= rs->r[mid].end)
+	lo = mid + 1;
+      else
+	return &rs->r[mid];
+    }
+  return NULL;
+}
+
+/* Nonzero if all of addr..addr+len is mapped in the job, which is
+   checked against the index instead of by trying the access. */
+static int mapped(struct job *j, uint64_t addr, size_t len)
+{
+  struct regions *rs;
+  struct region *r;
+  int retry = selfp(j);
+
+  if (!selfp(j) && j->state == 'r')
+    return 1;
+  if (!(rs = job_regions(j)))
+    return 1;
+
+  while (len)
+    {
+      if (!(r = find_region(rs, addr)))
+	{
+	  if (retry-- > 0)
+	    {
+	      refresh_regions(j);
+	      if ((rs = job_regions(j)))
+		continue;
+	    }
+	  errno = EFAULT;
+	  return 0;
+	}
+      if (r->end - addr >= len)
+	break;
+      len -= r->end - addr;
+      addr = r->end;
+    }
+  return 1;
+}
+
+/* Memory access.  Reads of a stopped job go through a small direct
+   mapped page cache that is filled with process_vm_readv and thrown
+   away whenever the job runs again.  A miss on the page a sequential
+   walk is heading for fetches READAHEAD pages at once.
+
+   Deposits are made into the cached pages and only written back, in
+   as few runs as possible, when the job is about to run or a dirty
+   page has to be evicted. */
+
+#define NOPAGE 1
+#define READAHEAD 8
+#define PAGEOF(a) ((a) & ~(uint64_t)(MEMPAGE - 1))
+#define SLOTOF(a) (((a) / MEMPAGE) % MEMCACHE_PAGES)
+
+void invalidate_mem(struct job *j)
+{
+  for (int i = 0; i < MEMCACHE_PAGES; i++)
+    {
+      j->proc.mem.tag[i] = NOPAGE;
+      j->proc.mem.dlo[i] = j->proc.mem.dhi[i] = 0;
+    }
+  j->proc.mem.ndirty = 0;
+  j->proc.mem.next = 0;
+}
+
+static int slotcmp(const void *a, const void *b, void *arg)
+{
+  uint64_t *tag = arg;
+  uint64_t x = tag[*(int *)a], y = tag[*(int *)b];
+  return (x > y) - (x < y);
+}
+
+/* Slow path for what process_vm_writev would not write, typically
+   deposits into read-only text: /proc/pid/mem ignores protection. */
+static int pwrite_mem(pid_t pid, struct iovec *local, struct iovec *remote,
+		      int n, size_t skip)
+{
+  char path[32];
+  int fd;
+
+  snprintf(path, sizeof(path), "/proc/%d/mem", pid);
+  if ((fd = open(path, O_RDWR | O_CLOEXEC)) == -1)
+    return 0;
+
+  for (int i = 0; i < n; i++)
+    {
+      if (skip >= local[i].iov_len)
+	{
+	  skip -= local[i].iov_len;
+	  continue;
+	}
+      if (pwrite(fd, (char *)local[i].iov_base + skip, local[i].iov_len - skip,
+		 (off_t)remote[i].iov_base + skip) != local[i].iov_len - skip)
+	{
+	  close(fd);
+	  return 0;
+	}
+      skip = 0;
+    }
+  close(fd);
+  return 1;
+}
+
+int flush_mem(struct job *j)
+{
+  struct memcache *m = &j->proc.mem;
+  int slots[MEMCACHE_PAGES];
+  struct iovec local[MEMCACHE_PAGES];
+  struct iovec remote[MEMCACHE_PAGES];
+  int nslots = 0;
+  int nlocal = 0;
+  int nremote = 0;
+  size_t total = 0;
   int ret = 1;
 
-  pushdot(pid, addr);
-  openloc = &dotring[dr_start];
-  if (pid)
+  if (!m->ndirty)
+    return 1;
+
+  for (int i = 0; i < MEMCACHE_PAGES; i++)
+    if (m->dhi[i] > m->dlo[i])
+      slots[nslots++] = i;
+  qsort_r(slots, nslots, sizeof(int), slotcmp, m->tag);
+
+  /* One local iovec per dirty slot; remote iovecs merge runs that
+     continue across page boundaries, so the whole buffer is written
+     back with a single call when the pages allow it. */
+  for (int i = 0; i < nslots; i++)
+    {
+      int s = slots[i];
+      local[nlocal].iov_base = m->pages + s * MEMPAGE + m->dlo[s];
+      local[nlocal].iov_len = m->dhi[s] - m->dlo[s];
+      uint64_t a = m->tag[s] + m->dlo[s];
+      if (nremote
+	  && (uint64_t)remote[nremote-1].iov_base + remote[nremote-1].iov_len == a)
+	remote[nremote-1].iov_len += local[nlocal].iov_len;
+      else
+	{
+	  remote[nremote].iov_base = (void *)a;
+	  remote[nremote].iov_len = local[nlocal].iov_len;
+	  nremote++;
+	}
+      total += local[nlocal].iov_len;
+      nlocal++;
+    }
+
+  errno = 0;
+  ssize_t n = process_vm_writev(j->proc.pid, local, nlocal, remote, nremote, 0);
+  if (n < 0)
+    n = 0;
+  if (n < total)
+    {
+      /* pwrite_mem wants the two lists in step, so go one slot at a
+	 time from here on. */
+      for (int i = 0; i < nslots; i++)
+	remote[i].iov_base = (void *)(m->tag[slots[i]] + m->dlo[slots[i]]);
+      ret = pwrite_mem(j->proc.pid, local, remote, nslots, n);
+    }
+
+  for (int i = 0; i < nslots; i++)
+    m->dlo[slots[i]] = m->dhi[slots[i]] = 0;
+  m->ndirty = 0;
+
+  return ret;
+}
+
+void release_mem(struct job *j)
+{
+  free(j->proc.mem.pages);
+  j->proc.mem.pages = NULL;
+  invalidate_mem(j);
+}
+
+static int fill_pages(struct job *j, uint64_t page, int npages)
+{
+  struct memcache *m = &j->proc.mem;
+  struct iovec local[READAHEAD];
+  struct iovec remote;
+  ssize_t n;
+
+  for (int i = 0; i < npages; i++)
+    if (m->dhi[SLOTOF(page + (uint64_t)i * MEMPAGE)])
+      {
+	if (!flush_mem(j))
+	  errout("deposit");
+	break;
+      }
+
+  for (int i = 0; i < npages; i++)
+    {
+      uint64_t a = page + (uint64_t)i * MEMPAGE;
+      m->tag[SLOTOF(a)] = NOPAGE;
+      local[i].iov_base = m->pages + SLOTOF(a) * MEMPAGE;
+      local[i].iov_len = MEMPAGE;
+    }
+  remote.iov_base = (void *)page;
+  remote.iov_len = (size_t)npages * MEMPAGE;
+
+  errno = 0;
+  if ((n = process_vm_readv(j->proc.pid, local, npages, &remote, 1, 0)) <= 0)
+    return 0;
+
+  for (int i = 0; i < n / MEMPAGE; i++)
+    m->tag[SLOTOF(page + (uint64_t)i * MEMPAGE)] = page + (uint64_t)i * MEMPAGE;
+
+  return n >= MEMPAGE;
+}
+
+static char *cached_page(struct job *j, uint64_t addr)
+{
+  struct memcache *m = &j->proc.mem;
+  uint64_t page = PAGEOF(addr);
+
+  if (m->pages && m->tag[SLOTOF(page)] == page)
+    return m->pages + SLOTOF(page) * MEMPAGE;
+
+  if (!m->pages)
+    {
+      if ((m->pages = malloc(MEMCACHE_PAGES * MEMPAGE)) == NULL)
+	return NULL;
+      invalidate_mem(j);
+    }
+
+  int npages = 1;
+  if (m->next && (page == PAGEOF(m->next) || page == PAGEOF(m->next) + MEMPAGE))
+    npages = READAHEAD;
+
+  if (!fill_pages(j, page, npages))
+    return NULL;
+
+  return m->pages + SLOTOF(page) * MEMPAGE;
+}
+
+/* Word at a time fallback, for pages process_vm_readv refuses but
+   ptrace can still see (no read permission, for instance). */
+static int peek_mem(pid_t pid, uint64_t addr, void *buf, size_t len)
+{
+  char *p = buf;
+
+  while (len)
     {
       errno = 0;
       long data = ptrace(PTRACE_PEEKDATA, pid, addr, NULL);
       if (errno)
+	return 0;
+      size_t n = len < sizeof(data) ? len : sizeof(data);
+      memcpy(p, &data, n);
+      p += n;
+      addr += n;
+      len -= n;
+    }
+  return 1;
+}
+
+/* DDT's own memory is read the same way as a running job's, after
+   checking the address against the index: a bad address is an error
+   return, never a fault. */
+static int fetch(struct job *j, uint64_t addr, void *buf, size_t len)
+{
+  if (selfp(j) || j->state == 'r')
+    {
+      struct iovec local = { buf, len };
+      struct iovec remote = { (void *)addr, len };
+      if (selfp(j) && !mapped(j, addr, len))
+	return 0;
+      errno = 0;
+      return process_vm_readv(selfp(j) ? getpid() : j->proc.pid,
+			      &local, 1, &remote, 1, 0) == len;
+    }
+
+  if (!mapped(j, addr, len))
+    return 0;
+
+  char *p = buf;
+  uint64_t a = addr;
+  size_t left = len;
+
+  while (left)
+    {
+      char *page = cached_page(j, a);
+      size_t off = a - PAGEOF(a);
+      size_t n = MEMPAGE - off;
+      if (n > left)
+	n = left;
+      if (page)
+	memcpy(p, page + off, n);
+      else if (!peek_mem(j->proc.pid, a, p, n))
+	return 0;
+      p += n;
+      a += n;
+      left -= n;
+    }
+
+  j->proc.mem.next = addr + len;
+  return 1;
+}
+
+/* Deposit.  Running jobs and DDT itself are written at once; a
+   stopped job collects the words in its page cache. */
+static int store(struct job *j, uint64_t addr, const void *buf, size_t len)
+{
+  pid_t pid = selfp(j) ? getpid() : j->proc.pid;
+  struct iovec local = { (void *)buf, len };
+  struct iovec remote = { (void *)addr, len };
+
+  if (selfp(j) || j->state == 'r')
+    {
+      if (selfp(j) && !mapped(j, addr, len))
+	return 0;
+      errno = 0;
+      if (process_vm_writev(pid, &local, 1, &remote, 1, 0) == len)
+	return 1;
+      return pid != getpid() && pwrite_mem(pid, &local, &remote, 1, 0);
+    }
+
+  if (!mapped(j, addr, len))
+    return 0;
+
+  struct memcache *m = &j->proc.mem;
+  const char *p = buf;
+  uint64_t a = addr;
+  size_t left = len;
+
+  while (left)
+    {
+      char *page = cached_page(j, a);
+      size_t off = a - PAGEOF(a);
+      size_t n = MEMPAGE - off;
+      if (n > left)
+	n = left;
+      if (page)
 	{
-	  errout("mem err?");
-	  ret = 0;
+	  int s = SLOTOF(a);
+	  memcpy(page + off, p, n);
+	  if (m->dhi[s] == m->dlo[s])
+	    {
+	      m->dlo[s] = off;
+	      m->dhi[s] = off + n;
+	      m->ndirty++;
+	    }
+	  else
+	    {
+	      if (off < m->dlo[s])
+		m->dlo[s] = off;
+	      if (off + n > m->dhi[s])
+		m->dhi[s] = off + n;
+	    }
 	}
       else
-	qreg = data;
+	{
+	  local.iov_base = (void *)p;
+	  local.iov_len = n;
+	  remote.iov_base = (void *)a;
+	  remote.iov_len = n;
+	  if (!pwrite_mem(pid, &local, &remote, 1, 0))
+	    return 0;
+	}
+      p += n;
+      a += n;
+      left -= n;
     }
+  return 1;
+}
+
+/* The job's memory as the program sees it, without breakpoints. */
+int read_mem(struct job *j, uint64_t addr, void *buf, size_t len)
+{
+  if (!fetch(j, addr, buf, len))
+    return 0;
+  if (!selfp(j))
+    shadow_bpts(&j->proc.bpts, addr, buf, len);
+  return 1;
+}
+
+int write_mem(struct job *j, uint64_t addr, const void *buf, size_t len)
+{
+  struct bpts *bs = selfp(j) ? NULL : &j->proc.bpts;
+  uint8_t *copy;
+  int ok;
+
+  if (!bs || !bs->used || addr > bs->hi || addr + len <= bs->lo)
+    return store(j, addr, buf, len);
+  if (!(copy = malloc(len)))
+    return 0;
+  memcpy(copy, buf, len);
+  if (cover_bpts(bs, addr, copy, len) == -1)
+    {
+      free(copy);
+      errno = EBUSY;
+      return 0;
+    }
+  ok = store(j, addr, copy, len);
+  free(copy);
+  return ok;
+}
+
+/* Deposit without regard to breakpoints, for their own code. */
+int patch_mem(struct job *j, uint64_t addr, const void *buf, size_t len)
+{
+  return store(j, addr, buf, len);
+}
+
+/* Put one byte straight into the job, bypassing the cache. */
+static int poke_byte(pid_t pid, uint64_t addr, uint8_t byte)
+{
+  long word;
+
+  errno = 0;
+  word = ptrace(PTRACE_PEEKDATA, pid, addr, NULL);
+  if (errno)
+    return 0;
+  word = (word & ~0xffL) | byte;
+  return ptrace(PTRACE_POKEDATA, pid, addr, word) != -1;
+}
+
+/* The register cache.  Each set is fetched with one PTRACE_GETREGSET
+   the first time it is wanted in a stop; a changed set is marked
+   dirty and put back by flush_regs() when the job is resumed. */
+
+static int regset(struct job *j, int req, int set, void *buf, size_t *len)
+{
+  static const int nt[5] = { 0, NT_PRSTATUS, NT_PRFPREG, 0, NT_X86_XSTATE };
+  struct iovec iov = { buf, *len };
+
+  if (ptrace(req, j->proc.pid, nt[set], &iov) == -1)
+    return 0;
+  *len = iov.iov_len;
+  return 1;
+}
+
+static void *fetch_regs(struct job *j, int set)
+{
+  struct regcache *rc = &j->proc.regs;
+  size_t len;
+  void *buf;
+
+  switch (set)
+    {
+    case REGS_GP:
+      buf = &rc->gp;
+      len = sizeof(rc->gp);
+      break;
+    case REGS_FP:
+      buf = &rc->fp;
+      len = sizeof(rc->fp);
+      break;
+    default:
+      if (!rc->xstate && !(rc->xstate = malloc(XSTATE_SIZE)))
+	return NULL;
+      buf = rc->xstate;
+      len = XSTATE_SIZE;
+      break;
+    }
+  if (!(rc->valid & set))
+    {
+      if (!regset(j, PTRACE_GETREGSET, set, buf, &len))
+	return NULL;
+      if (set == REGS_XSTATE)
+	rc->xlen = len;
+      rc->valid |= set;
+    }
+  return buf;
+}
+
+struct user_regs_struct *job_regs(struct job *j)
+{
+  return fetch_regs(j, REGS_GP);
+}
+
+struct user_fpregs_struct *job_fpregs(struct job *j)
+{
+  return fetch_regs(j, REGS_FP);
+}
+
+void *job_xstate(struct job *j, size_t *len)
+{
+  void *x = fetch_regs(j, REGS_XSTATE);
+  *len = j->proc.regs.xlen;
+  return x;
+}
+
+/* Set the pc of the stopped job j. */
+int set_pc(struct job *j, uint64_t pc)
+{
+  struct user_regs_struct *regs = job_regs(j);
+
+  if (!regs)
+    return 0;
+  regs->rip = pc;
+  j->proc.regs.dirty |= REGS_GP;
+  return 1;
+}
+
+/* Write back the changed sets, and forget them all: the job is about
+   to run. */
+static int flush_regs(struct job *j)
+{
+  struct regcache *rc = &j->proc.regs;
+  int ok = 1;
+  size_t len;
+
+  if (rc->dirty & REGS_GP)
+    ok &= regset(j, PTRACE_SETREGSET, REGS_GP, &rc->gp, (len = sizeof(rc->gp), &len));
+  if (rc->dirty & REGS_FP)
+    ok &= regset(j, PTRACE_SETREGSET, REGS_FP, &rc->fp, (len = sizeof(rc->fp), &len));
+  if (rc->dirty & REGS_XSTATE)
+    ok &= regset(j, PTRACE_SETREGSET, REGS_XSTATE, rc->xstate, (len = rc->xlen, &len));
+  rc->valid = rc->dirty = 0;
+  return ok;
+}
+
+#define GP(r) { #r, offsetof(struct user_regs_struct, r) }
+
+static const struct { const char *name; size_t off; } gpnames[] = {
+  GP(rax), GP(rbx), GP(rcx), GP(rdx), GP(rsi), GP(rdi), GP(rbp), GP(rsp),
+  GP(r8), GP(r9), GP(r10), GP(r11), GP(r12), GP(r13), GP(r14), GP(r15),
+  GP(rip), GP(eflags), GP(orig_rax), GP(fs_base), GP(gs_base),
+  GP(cs), GP(ss), GP(ds), GP(es), GP(fs), GP(gs),
+};
+
+#define YMMH_OFFSET 576		/* AVX upper halves in the XSAVE area */
+
+/* The value of the register called name, len characters long, in
+   the stopped job j.  The vector registers give their low 64 bits:
+   xmm0-xmm15 from the FP set, ymmh0-ymmh15, the upper halves of the
+   ymm registers, from the XSAVE area. */
+int reg_value(struct job *j, const char *name, size_t len, uint64_t *v)
+{
+  struct user_fpregs_struct *fp;
+  char buf[16], *end;
+  size_t xlen;
+  char *x;
+  long n;
+
+  if (len >= sizeof(buf))
+    return 0;
+  memcpy(buf, name, len);
+  buf[len] = 0;
+
+  for (size_t i = 0; i < sizeof(gpnames) / sizeof(gpnames[0]); i++)
+    if (!strcmp(buf, gpnames[i].name))
+      {
+	char *gp = (char *)job_regs(j);
+	if (!gp)
+	  return 0;
+	memcpy(v, gp + gpnames[i].off, sizeof(*v));
+	return 1;
+      }
+
+  if (!strcmp(buf, "mxcsr"))
+    {
+      if (!(fp = job_fpregs(j)))
+	return 0;
+      *v = fp->mxcsr;
+      return 1;
+    }
+  if (!strncmp(buf, "xmm", 3) && isdigit(buf[3])
+      && (n = strtol(buf + 3, &end, 10)) < 16 && !*end)
+    {
+      if (!(fp = job_fpregs(j)))
+	return 0;
+      memcpy(v, &fp->xmm_space[4 * n], sizeof(*v));
+      return 1;
+    }
+  if (!strncmp(buf, "ymmh", 4) && isdigit(buf[4])
+      && (n = strtol(buf + 4, &end, 10)) < 16 && !*end)
+    {
+      if (!(x = job_xstate(j, &xlen)) || xlen < YMMH_OFFSET + 16 * (n + 1))
+	return 0;
+      memcpy(v, x + YMMH_OFFSET + 16 * n, sizeof(*v));
+      return 1;
+    }
+  return 0;
+}
+
+void release_regs(struct job *j)
+{
+  free(j->proc.regs.xstate);
+  memset(&j->proc.regs, 0, sizeof(struct regcache));
+}
+
+static struct bpt *pc_bpt(struct job *j)
+{
+  struct user_regs_struct *regs;
+
+  if (!j->proc.bpts.used || !(regs = job_regs(j)))
+    return NULL;
+  return find_bpt(&j->proc.bpts, regs->rip);
+}
+
+/* A seccomp filter returning SECCOMP_RET_TRACE, :strace's or the
+   job's own, stops the job at the entry of a system call it steps
+   over; that stop is not the end of the step. */
+#define SECCOMP_STOP(status) ((status) >> 8 == (SIGTRAP | PTRACE_EVENT_SECCOMP << 8))
+
+/* Single step j, lifting b, the breakpoint at the pc if any, for the
+   one instruction, and wait for the step.  Returns 1 if the job
+   stopped with the SIGTRAP of the step; any other stop or exit is
+   left unreaped for check_jobs() to report. */
+static int singlestep(struct job *j, struct bpt *b)
+{
+  pid_t pid = j->proc.pid;
+  uint64_t addr = b ? b->addr : 0;
+  siginfo_t si;
+  int r, status;
+
+  if (b && !poke_byte(pid, addr, b->orig))
+    return 0;
+  errno = 0;
+  if ((r = ptrace(PTRACE_SINGLESTEP, pid, NULL, NULL)) != -1)
+    while ((r = waitid(P_PID, pid, &si, WEXITED|WSTOPPED|WNOWAIT)) == -1
+	   && errno == EINTR)
+      ;
+  if (b)
+    poke_byte(pid, addr, INT3);
+  if (r == -1 || si.si_code != CLD_TRAPPED || si.si_status != SIGTRAP)
+    return 0;
+  waitpid(pid, &status, 0);
+  j->proc.status = status;
+  return 1;
+}
+
+/* Make the stopped job j do a system call, by putting a syscall
+   instruction at its pc and stepping it.  Returns what the call
+   returned, or -errno if the job would not do it. */
+long remote_syscall(struct job *j, long nr, long a1, long a2, long a3,
+		    long a4, long a5, long a6)
+{
+  pid_t pid = j->proc.pid;
+  struct user_regs_struct saved, regs, *r;
+  long word, ret;
+  int status;
+
+  if (!flush_mem(j) || !flush_regs(j) || !(r = job_regs(j)))
+    return -errno;
+  saved = *r;
+  j->proc.regs.valid = 0;
+  errno = 0;
+  word = ptrace(PTRACE_PEEKDATA, pid, saved.rip, NULL);
+  if (errno)
+    return -errno;
+
+  /* orig_rax -1 keeps the kernel from restarting a system call the
+     job was stopped in before ours. */
+  regs = saved;
+  regs.orig_rax = -1;
+  regs.rax = nr;
+  regs.rdi = a1;
+  regs.rsi = a2;
+  regs.rdx = a3;
+  regs.r10 = a4;
+  regs.r8 = a5;
+  regs.r9 = a6;
+  if (ptrace(PTRACE_POKEDATA, pid, saved.rip, (word & ~0xffffL) | 0x050f) == -1
+      || ptrace(PTRACE_SETREGS, pid, NULL, &regs) == -1
+      || ptrace(PTRACE_SINGLESTEP, pid, NULL, NULL) == -1)
+    {
+      ret = -errno;
+      goto out;
+    }
+  do
+    while (waitpid(pid, &status, 0) == -1)
+      if (errno != EINTR)
+	{
+	  ret = -errno;
+	  goto out;
+	}
+  while (WIFSTOPPED(status) && SECCOMP_STOP(status)
+	 && ptrace(PTRACE_SINGLESTEP, pid, NULL, NULL) != -1);
+  if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGTRAP || SECCOMP_STOP(status))
+    {
+      job_changed(j, status);
+      return -EIO;
+    }
+  ret = ptrace(PTRACE_GETREGS, pid, NULL, &regs) == -1 ? -errno : (long)regs.rax;
+
+ out:
+  ptrace(PTRACE_POKEDATA, pid, saved.rip, word);
+  ptrace(PTRACE_SETREGS, pid, NULL, &saved);
+  refresh_regions(j);
+  return ret;
+}
+
+static void sync_mem(struct job *j)
+{
+  j->proc.bpts.at = 0;
+  if (!flush_mem(j))
+    errout("deposit");
+  take_snap(j);
+  invalidate_mem(j);
+  if (!flush_regs(j))
+    errout("registers");
+  j->proc.runs++;
+}
+
+/* Resume j, first stepping over a breakpoint it is stopped at.  At
+   a conditional one it goes on in the trampoline, past the int3, and
+   at a tracepoint's jmp, which is good code, it just goes on; the
+   int3 of a trampoline itself it skips. */
+int cont_job(struct job *j)
+{
+  struct bpt *b;
+
+  if ((b = pc_bpt(j)) && (b->flags & BPT_COND))
+    set_pc(j, b->link + 1);
+  else if (b && (b->flags & BPT_STUB))
+    set_pc(j, b->addr + 1);
+  sync_mem(j);
+  if (b && !(b->flags & (BPT_JMP | BPT_STUB)) && !singlestep(j, b))
+    return 1;
+  return ptrace_cont(j->proc.pid);
+}
+
+/* Resume j until it leaves the system call it is entering, for
+   :strace. */
+int cont_syscall(struct job *j)
+{
+  sync_mem(j);
+  return ptrace(PTRACE_SYSCALL, j->proc.pid, NULL, NULL) != -1;
+}
+
+int detach_job(struct job *j)
+{
+  if (strace_filtered(j))
+    fputs("job keeps its :strace seccomp filter; traced calls will fail with ENOSYS\r\n",
+	  stderr);
+  if (!clear_bpts(j))
+    errout("breakpoints");
+  sync_mem(j);
+  return ptrace_detach(j->proc.pid);
+}
+
+/* Single steps j one instruction, flushing its registers first and
+   waiting for the step.  Returns 1 when it stopped with the SIGTRAP
+   of the step, 0 with *status set for any other stop or exit, -1 if
+   ptrace fails.  A system call the step makes that :strace traces is
+   typed as if the job had been running. */
+static int step_insn(struct job *j, int *status)
+{
+  struct user_regs_struct *regs;
+  pid_t pid = j->proc.pid;
+  int r, traced = 0;
+
+  if (!flush_regs(j))
+    return -1;
+  for (;;)
+    {
+      if (ptrace(PTRACE_SINGLESTEP, pid, NULL, NULL) == -1)
+	return -1;
+      while ((r = waitpid(pid, status, 0)) == -1 && errno == EINTR)
+	;
+      if (r == -1)
+	return -1;
+      if (!WIFSTOPPED(*status) || !SECCOMP_STOP(*status))
+	break;
+      traced = strace_step(j);
+    }
+  j->proc.status = *status;
+  if (!WIFSTOPPED(*status) || WSTOPSIG(*status) != SIGTRAP)
+    return 0;
+  if (traced && (regs = job_regs(j)))
+    strace_return(j, regs->rax);
+  return 1;
+}
+
+/* Steps j, stopped at the jmp of the conditional breakpoint b, through
+   the condition in b's trampoline, to the int3 if the condition holds
+   or just past it if not.  The steps are neither counted nor traced.
+   Returns 1 at the int3, 0 past it, -1 if the job stopped otherwise
+   or could not be stepped, having reported that. */
+static int step_cond(struct job *j, struct bpt *b)
+{
+  struct user_regs_struct *rp;
+  int status, r;
+
+  for (;;)
+    {
+      if ((r = step_insn(j, &status)) != 1)
+	{
+	  if (r == -1)
+	    errout("ptrace");
+	  else
+	    job_changed(j, status);
+	  return -1;
+	}
+      if (!(rp = job_regs(j)))
+	{
+	  errout("ptrace");
+	  return -1;
+	}
+      if (rp->rip == b->link || rp->rip == b->link + 1)
+	return rp->rip == b->link;
+    }
+}
+
+/* ^N and <n>^N.  Steps n instructions in a loop that waits for each
+   step itself, noting the pc, stack pointer and flags before each in
+   the job's trace ring.  A breakpoint reached on the way is hit as if
+   the job had run into it: its condition is tested by stepping
+   through the trampoline, and its proceed count is counted down by
+   bpt_hit().  Stops early at one that stops the job, or at a MAR,
+   and leaves any other stop or exit to job_changed().  Returns
+   nonzero if it has typed where the job stopped. */
+int step_job(struct job *j, uint64_t n)
+{
+  pid_t pid = j->proc.pid;
+  struct user_regs_struct regs, *rp;
+  struct bpt *b;
+  int status, r;
+
+  if (!j->proc.trace
+      && !(j->proc.trace = malloc(TRACE_RING * sizeof(struct tracent))))
+    errout("trace");
+
+  sync_mem(j);
+  for (uint64_t i = 0; i < n; i++)
+    {
+      if (!(rp = job_regs(j)))
+	{
+	  errout("ptrace");
+	  return 0;
+	}
+      b = find_bpt(&j->proc.bpts, rp->rip);
+      if (b && (b->flags & (BPT_STUB | BPT_TRACE)))
+	b = NULL;
+      if (b && i && (b->flags & BPT_COND))
+	{
+	  if ((r = step_cond(j, b)) == -1)
+	    return 0;
+	  if (!r)
+	    b = NULL;		/* go on with the displaced instructions */
+	  else
+	    set_pc(j, b->addr);
+	  if (!(rp = job_regs(j)))
+	    {
+	      errout("ptrace");
+	      return 0;
+	    }
+	}
+      if (b && i && bpt_hit(j, b))
+	return 1;
+      regs = *rp;
+      if (j->proc.trace)
+	{
+	  struct tracent *t = &j->proc.trace[j->proc.ntrace++ % TRACE_RING];
+	  t->rip = regs.rip;
+	  t->rsp = regs.rsp;
+	  t->flags = regs.eflags;
+	}
+      record_step(j, regs.rip);
+
+      if (b && (b->flags & BPT_COND))
+	{
+	  set_pc(j, b->link + 1);
+	  b = NULL;
+	}
+      if (b && !poke_byte(pid, b->addr, b->orig))
+	{
+	  errout("breakpoint");
+	  return 0;
+	}
+      r = step_insn(j, &status);
+      if (b)
+	poke_byte(pid, b->addr, INT3);
+      if (r == -1)
+	{
+	  errout("ptrace");
+	  return 0;
+	}
+      if (!r)
+	{
+	  job_changed(j, status);
+	  return 0;
+	}
+      if (mar_trap(j))
+	return 1;
+    }
+  return 0;
+}
+
+/* :trace [<n>] types the last n, by default 20, instructions
+   stepped, oldest first. */
+void trace(char *arg)
+{
+  struct job *j = currjob;
+  uint64_t n = 20;
+
+  if (!j || !j->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  if (arg && *arg)
+    n = strtoull(arg, NULL, 0);
+  if (n > j->proc.ntrace)
+    n = j->proc.ntrace;
+  if (n > TRACE_RING)
+    n = TRACE_RING;
+
+  fputs("\r\n", stderr);
+  for (uint64_t i = j->proc.ntrace - n; i < j->proc.ntrace; i++)
+    {
+      struct tracent *t = &j->proc.trace[i % TRACE_RING];
+      outsym(j, t->rip);
+      fprintf(stderr, ")   rsp %lx   flags %lx\r\n", t->rsp, t->flags);
+    }
+}
+
+/* $^N.  If the instruction at the pc is a call, plants a one-shot
+   breakpoint after it, good only when the stack is back where it is
+   now, and returns 1; the job is then simply continued.  Returns 0
+   if it is not a call, -1 on error. */
+int stepover_job(struct job *j)
+{
+  struct user_regs_struct *regs;
+  uint8_t insn[16];
+  int len;
+
+  errno = 0;
+  if (!(regs = job_regs(j)))
+    return -1;
+  if (!read_mem(j, regs->rip, insn, sizeof(insn))
+      || !(len = call_length(insn, sizeof(insn))))
+    return 0;
+  return set_tbpt(j, regs->rip + len, regs->rsp) ? 1 : -1;
+}
+
+/* How well the word at slot does as the return address of a
+   function containing pc: 0 if it does not follow a call at all, 1
+   if it follows an indirect call, and 2 plus the called address if
+   it follows a direct call to an address at or before pc. */
+static uint64_t retscore(struct job *j, uint64_t slot, uint64_t pc,
+			 uint64_t *ret)
+{
+  uint8_t insn[7];
+  int32_t rel;
+
+  if (!read_mem(j, slot, ret, sizeof(*ret))
+      || !read_mem(j, *ret - sizeof(insn), insn, sizeof(insn)))
+    return 0;
+  if (call_length(insn + 2, 5) == 5 && insn[2] == 0xe8)
+    {
+      memcpy(&rel, insn + 3, sizeof(rel));
+      return *ret + rel <= pc ? 2 + *ret + rel : 0;
+    }
+  for (int k = 2; k <= 7; k++)
+    if (call_length(insn + 7 - k, k) == k)
+      return 1;
+  return 0;
+}
+
+/* $$^N.  Plants a one-shot breakpoint at the return address of the
+   current function.  That is on top of the stack at the entry and
+   at the ret; elsewhere it is either still there, in a function
+   without a frame, or found through the frame pointer.  Of those
+   two, the one returning from a call to the nearest address below
+   the pc wins, as stale return addresses lie about below the stack
+   pointer. */
+int stepout_job(struct job *j)
+{
+  struct user_regs_struct regs, *rp;
+  uint8_t insn[4];
+  uint64_t slot, ret, fret;
+
+  errno = 0;
+  if (!(rp = job_regs(j)) || !read_mem(j, (regs = *rp).rip, insn, sizeof(insn)))
+    return 0;
+  if (insn[0] == 0xc3 || insn[0] == 0xc2 || insn[0] == 0x55	/* ret, push %rbp */
+      || !memcmp(insn, "\xf3\x0f\x1e\xfa", 4))		/* endbr64 */
+    slot = regs.rsp;
+  else if (!memcmp(insn, "\x48\x89\xe5", 3))		/* mov %rsp,%rbp */
+    slot = regs.rsp + 8;
+  else if (retscore(j, regs.rsp, regs.rip, &ret)
+	   > retscore(j, regs.rbp + 8, regs.rip, &fret))
+    slot = regs.rsp;
   else
+    slot = regs.rbp + 8;
+  if (!read_mem(j, slot, &ret, sizeof(ret)))
+    return 0;
+  return set_tbpt(j, ret, slot + 8);
+}
+
+/* Called when j stops with SIGTRAP, status being the wait status.
+   Breakpoints are told from other traps by the SI_KERNEL code the
+   kernel gives int3; a hit backs the pc up over the int3 and, unless
+   the breakpoint is to stop the job, resumes it straight away.
+   Seccomp and system call stops are :strace's. */
+int job_trap(struct job *j, int status)
+{
+  pid_t pid = j->proc.pid;
+  struct user_regs_struct *regs;
+  siginfo_t si;
+  struct bpt *b;
+
+  if (SECCOMP_STOP(status) || WSTOPSIG(status) == (SIGTRAP | 0x80))
+    return strace_stop(j);
+
+  if (j->proc.bpts.used
+      && ptrace(PTRACE_GETSIGINFO, pid, NULL, &si) != -1
+      && si.si_code == SI_KERNEL)
     {
-      struct sigaction sa;
-      memset(&sa, 0, sizeof(sigaction));
-      sigemptyset(&sa.sa_mask);
-      sa.sa_flags = SA_SIGINFO | SA_RESETHAND;
-      sa.sa_sigaction = segvhandler;
-      sigaction(SIGSEGV, &sa, NULL);
-      if (setjmp(point) == 0)
-	qreg = *(char *)addr;
-      else
+      uint64_t pc = (regs = job_regs(j)) ? regs->rip - 1 : 0;
+      if (regs && (b = find_bpt(&j->proc.bpts, pc)))
 	{
-	  fprintf(stderr, "mem err? ");
-	  ret = 0;
+	  /* A conditional breakpoint's int3 is in its trampoline. */
+	  if ((b->flags & BPT_STUB)
+	      && (b = find_bpt(&j->proc.bpts, b->link)))
+	    pc = b->addr;
+	  if (!b)
+	    return STOP_SIGNAL;
+	  set_pc(j, pc);
+	  if (bpt_hit(j, b))
+	    return STOP_TRAP;
+	  if (cont_job(j))
+	    return STOP_RESUMED;
+	  errout("ptrace cont");
+	  return STOP_TRAP;
 	}
     }
+  return mar_trap(j) ? STOP_TRAP : STOP_SIGNAL;
+}
+
+/* The MAR.  Each job has NMAR of them, kept in the debug registers
+   of its thread: DR0-DR3 hold the addresses and DR7 enables them. */
+
+#define DR(n) (offsetof(struct user, u_debugreg) + (n) * sizeof(long))
+
+static int load_mars(struct job *j)
+{
+  uint64_t dr7 = 0;
+
+  errno = 0;
+  if (ptrace(PTRACE_POKEUSER, j->proc.pid, DR(7), 0) == -1)
+    return 0;
+  for (int i = 0; i < NMAR; i++)
+    {
+      struct mar *m = &j->proc.mar[i];
+      /* Type 00 is execute, 01 write, 11 read or write.  Data
+	 watches cover the whole word, length bits 10. */
+      static const int rw[4] = { 0, 0, 1, 3 };
+      if (!m->mode)
+	continue;
+      if (ptrace(PTRACE_POKEUSER, j->proc.pid, DR(i), m->addr) == -1)
+	return 0;
+      dr7 |= 1 << (2 * i);
+      dr7 |= (uint64_t)rw[m->mode] << (16 + 4 * i);
+      if (m->mode != 1)
+	dr7 |= (uint64_t)2 << (18 + 4 * i);
+    }
+  return dr7 == 0
+    || ptrace(PTRACE_POKEUSER, j->proc.pid, DR(7), dr7) != -1;
+}
+
+/* Set a MAR of mode 1 (fetch), 2 (write) or 3 (any reference) at
+   addr, reusing one already at addr.  Mode 0 clears the one at addr,
+   as it was stored: a fetch MAR keeps its address unaligned.
+   Returns 0 with errno set on failure, ENOSPC if all are in use. */
+int set_mar(struct job *j, uint64_t addr, int mode)
+{
+  struct mar *m = NULL;
+  uint64_t aligned = addr & ~(uint64_t)7;
+
+  if (mode > 1)
+    addr = aligned;
+  for (int i = 0; i < NMAR; i++)
+    {
+      struct mar *x = &j->proc.mar[i];
+      if (x->mode && (x->addr == addr || (!mode && x->mode > 1 && x->addr == aligned)))
+	m = x;
+    }
+  if (!m && mode)
+    for (int i = 0; i < NMAR && !m; i++)
+      if (!j->proc.mar[i].mode)
+	m = &j->proc.mar[i];
+  if (!m)
+    {
+      errno = mode ? ENOSPC : ENOENT;
+      return 0;
+    }
+  m->addr = addr;
+  m->mode = mode;
+  if (!load_mars(j))
+    {
+      m->mode = 0;
+      load_mars(j);
+      return 0;
+    }
+  return 1;
+}
+
+int clear_mars(struct job *j)
+{
+  memset(j->proc.mar, 0, sizeof(j->proc.mar));
+  return load_mars(j);
+}
+
+void list_mars(struct job *j)
+{
+  static const char *how[4] = { "", "fetch", "write", "ref" };
+
+  for (int i = 0; i < NMAR; i++)
+    if (j->proc.mar[i].mode)
+      fprintf(stderr, "\r\nMAR%d  %lx  %s", i + 1,
+	      j->proc.mar[i].addr, how[j->proc.mar[i].mode]);
+  fputs("\r\n", stderr);
+}
+
+/* Called when j stops with SIGTRAP.  If DR6 says a MAR tripped,
+   types MAR<n>; and the pc and returns n, else returns 0. */
+int mar_trap(struct job *j)
+{
+  int active = 0;
+  long dr6;
+
+  for (int i = 0; i < NMAR; i++)
+    if (j->proc.mar[i].mode)
+      active |= 1 << i;
+  if (!active)
+    return 0;
+
+  errno = 0;
+  dr6 = ptrace(PTRACE_PEEKUSER, j->proc.pid, DR(6), NULL);
+  if (errno || !(dr6 & active))
+    return 0;
+  ptrace(PTRACE_POKEUSER, j->proc.pid, DR(6), 0);
+
+  int n = __builtin_ctz(dr6 & active) + 1;
+  fprintf(stderr, "MAR%d; ", n);
+  typeout_pc(j);
+  fputs("\r\n", stderr);
+  return n;
+}
+
+void pushdot(pid_t pid, uint64_t value)
+{
+  dr_end = ++dr_end % DOTRING_SIZE;
+
+  dotring[dr_end].pid = pid;
+  dotring[dr_end].addr = value;
+
+  if (dr_end == dr_start)
+    dr_start = ++dr_start % DOTRING_SIZE;
+}
+
+int openlocation(struct job *j, uint64_t addr)
+{
+  int ret = 1;
+  pid_t pid = j ? j->proc.pid : 0;
+
+  uint64_t data;
+
+  pushdot(pid, addr);
+  openloc = &dotring[dr_end];
+  if (!read_mem(j, addr, &data, sizeof(data)))
+    {
+      errout("mem err?");
+      ret = 0;
+    }
+  else
+    qreg = data;
 
   return ret;
 }
@@ -126,6 +1357,30 @@ void closelocation(void)
   openloc = NULL;
 }
 
+uint64_t nextlocation(void)
+{
+  return dotring[dr_end].addr + sizeof(uint64_t);
+}
+
+int depositlocation(struct job *j, uint64_t value)
+{
+  if (!openloc)
+    return 1;
+
+  if (openloc->pid != (j ? j->proc.pid : 0))
+    {
+      fputs(" job? ", stderr);
+      return 0;
+    }
+
+  if (!write_mem(j, openloc->addr, &value, sizeof(value)))
+    {
+      errout("deposit");
+      return 0;
+    }
+  return 1;
+}
+
 int ptrace_seize(pid_t pid)
 {
   errno = 0;
@@ -163,53 +1418,118 @@ int ptrace_cont(pid_t pid)
 
 void unload_symbols(struct job *j)
 {
-  munmap(j->proc.syms, j->proc.symlen);
+  free_symindex(j->proc.symidx);
+  j->proc.symidx = NULL;
+  elf_close(j->proc.syms);
+  j->proc.syms = NULL;
 }
 
-void load_symbols(struct job *j)
+/* Loads symbols from the file open on fd, which it takes, or from j's
+   executable if fd is -1; from the separate debug file instead if the
+   one given has been stripped. */
+void load_symbols(struct job *j, int fd)
 {
-  Elf64_Ehdr *ehdr;
-  struct stat status;
+  struct elffile *f;
 
+  if (j->proc.syms)
+    unload_symbols(j);
+  if (fd == -1)
+    fd = fcntl(j->proc.ufname.fd, F_DUPFD_CLOEXEC, 0);
   errno = 0;
-  fstatat(j->proc.ufname.fd, "", &status, AT_EMPTY_PATH);
-  if (!errno)
+  if (!(f = elf_fdopen(fd)))
     {
-      if ((ehdr = (Elf64_Ehdr *)mmap(0, status.st_size,
-				     PROT_READ, MAP_PRIVATE,
-				     j->proc.ufname.fd, 0)) != (Elf64_Ehdr *)(MAP_FAILED))
-	{
-	  j->proc.syms = (char *)ehdr;
-	  j->proc.symlen = status.st_size;
-	}
+      if (errno)
+	errout("symbols");
       else
-	errout("mmap");
+	fputs(" not ELF? ", stderr);
+      return;
     }
-  else
-    errout("fstatat");
+  j->proc.syms = elf_debug_file(f);
+  j->proc.symidx = cached_symbols(j->proc.syms);
+  j->proc.biaspid = 0;
+}
+
+/* Where j's executable is loaded, if it is position independent:
+   the start of its mapping at file offset 0, less the address the
+   file gives that.  Found from the region index once per process. */
+static int exec_bias(struct job *j, uint64_t *bias)
+{
+  struct regions *rs;
+  struct stat st;
+
+  if (j->proc.biaspid && j->proc.biaspid == j->proc.pid)
+    {
+      *bias = j->proc.symbias;
+      return 1;
+    }
+  if (!j->proc.pid
+      || fstatat(j->proc.ufname.fd, "", &st, AT_EMPTY_PATH) == -1
+      || !(rs = job_regions(j)))
+    return 0;
+  for (int i = 0; i < rs->n; i++)
+    if (rs->r[i].inode == st.st_ino && rs->r[i].offset == 0)
+      {
+	j->proc.symbias = *bias = rs->r[i].start - j->proc.symidx->lo;
+	j->proc.biaspid = j->proc.pid;
+	return 1;
+      }
+  return 0;
+}
+
+/* The name of the symbol that addr is in, and how far in: one of j's
+   executable, else of a shared object. */
+const char *job_symbol(struct job *j, uint64_t addr, uint64_t *off)
+{
+  const struct symbol *s;
+  uint64_t bias = 0;
+
+  if (!j)
+    return NULL;
+  if (j->proc.symidx
+      && (!j->proc.symidx->pie || exec_bias(j, &bias))
+      && (s = find_symbol(j->proc.symidx, addr - bias)))
+    {
+      *off = addr - bias - s->addr;
+      return j->proc.symidx->arena + s->name;
+    }
+  return solib_symbol(j, addr, off);
+}
+
+/* The address of the symbol called name, len characters long, in j's
+   executable or else a shared object. */
+int job_symvalue(struct job *j, const char *name, size_t len, uint64_t *value)
+{
+  uint64_t bias = 0;
+
+  if (!j)
+    return 0;
+  if (symbol_value(j->proc.symidx, name, len, value)
+      && (!j->proc.symidx->pie || exec_bias(j, &bias)))
+    {
+      *value += bias;
+      return 1;
+    }
+  return solib_symvalue(j, name, len, value);
 }
 
 void listp(char *unused)
 {
+  struct elffile *f;
+
   if (!currjob)
     {
       fprintf(stderr, " job? ");
       return;
     }
-  if (!currjob->proc.syms)
+  if (!(f = currjob->proc.syms))
     {
       fprintf(stderr, " not loaded? ");
       return;
     }
 
-  Elf64_Ehdr *ehdr = (Elf64_Ehdr *)currjob->proc.syms;
-  Elf64_Shdr *shdr = (Elf64_Shdr *)(currjob->proc.syms + ehdr->e_shoff);
-  Elf64_Shdr *sh_strtab = &shdr[ehdr->e_shstrndx];
-  const char *const sh_strtab_p = currjob->proc.syms + sh_strtab->sh_offset;
-
-  for (int i = 0; i < ehdr->e_shnum; i++)
+  for (int i = 0; i < f->ehdr.e_shnum; i++)
     {
-      const char *s = sh_strtab_p + shdr[i].sh_name;
+      const char *s = elf_secname(f, i);
       if (*s)
 	fprintf(stderr, "%-16s ", s);
       if ((i % 4) == 0)
@@ -220,61 +1540,47 @@ void listp(char *unused)
 
 void lists(char *unused)
 {
+  struct elffile *f;
+
   if (!currjob)
     {
       fprintf(stderr, " job? ");
       return;
     }
-  if (!currjob->proc.syms)
+  if (!(f = currjob->proc.syms))
     {
       fprintf(stderr, " not loaded? ");
       return;
     }
 
-  Elf64_Ehdr *ehdr = (Elf64_Ehdr *)currjob->proc.syms;
-  Elf64_Shdr *shdr = (Elf64_Shdr *)(currjob->proc.syms + ehdr->e_shoff);
-  Elf64_Shdr *sh_strtab = &shdr[ehdr->e_shstrndx];
-  const char *const sh_strtab_p = currjob->proc.syms + sh_strtab->sh_offset;
-  Elf64_Shdr *strtab = NULL;
-  Elf64_Shdr *symtab = NULL;
-
-  for (int i = 0; i < ehdr->e_shnum; i++)
-    {
-      switch (shdr[i].sh_type)
-	{
-	case SHT_SYMTAB:
-	  if (strcmp(sh_strtab_p + shdr[i].sh_name, ".symtab") == 0)
-	    symtab = &shdr[i];
-	  break;
-	case SHT_STRTAB:
-	  if (strcmp(sh_strtab_p + shdr[i].sh_name, ".strtab") == 0)
-	    strtab = &shdr[i];
-	  break;
-	default:
-	  continue;
-	}
-    }
+  int strtab = elf_find(f, SHT_STRTAB, ".strtab");
+  int symtab = elf_find(f, SHT_SYMTAB, ".symtab");
 
   crlf();
 
-  if (strtab == NULL)
+  if (!strtab)
     {
       fprintf(stderr, " no string table?\r\n");
       return;
     }
-  if (symtab == NULL)
+  if (!symtab)
     {
       fprintf(stderr, " no symbol table?\r\n");
       return;
     }
 
+  const Elf64_Sym *symtab_p = elf_section(f, symtab);
+  const char *const strtab_p = elf_section(f, strtab);
+  size_t strsz = f->shdr[strtab].sh_size;
+  int qsyms = f->shdr[symtab].sh_size / sizeof(Elf64_Sym);
 
-  Elf64_Sym *symtab_p = (Elf64_Sym *)(currjob->proc.syms + symtab->sh_offset);
-  const char *const strtab_p = currjob->proc.syms + strtab->sh_offset;
-  int qsyms = symtab->sh_size / symtab->sh_entsize;
-
+  if (!symtab_p || !strtab_p || strtab_p[strsz - 1])
+    {
+      fprintf(stderr, " bad symbol table?\r\n");
+      return;
+    }
   for (int i = 0; i < qsyms; i++)
-    if (symtab_p[i].st_name)
+    if (symtab_p[i].st_name && symtab_p[i].st_name < strsz)
       fprintf(stderr, "%s\r\n", strtab_p + symtab_p[i].st_name);
 }
 
@@ -290,21 +1596,24 @@ void symlod(char *arg)
 
   if (arg && *arg)
     {
-      fprintf(stderr, "Would load symbols from %s\r\n", arg);
+      int fd = open_file(arg);
+      if (fd != -1)
+	load_symbols(currjob, fd);
       return;
     }
 
-  if (currjob->proc.syms)
-    unload_symbols(currjob);
-
-  load_symbols(currjob);
+  load_symbols(currjob, -1);
 }
 
 void typeout_pc(struct job *j)
 {
-  long pc = ptrace(PTRACE_PEEKUSER, j->proc.pid, RIP * 8, NULL);
-  long data = ptrace(PTRACE_PEEKDATA, j->proc.pid, pc, NULL);
+  struct user_regs_struct *regs = job_regs(j);
+  uint64_t pc = regs ? regs->rip : 0, data;
 
-  fprintf(stderr, "%lx)   ", pc);
-  sch(data);
+  outsym(j, pc);
+  fputs(")   ", stderr);
+  if (read_mem(j, pc, &data, sizeof(data)))
+    sch(data);
+  else
+    fputs("?   ", stderr);
 }
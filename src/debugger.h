@@ -19,14 +19,49 @@ along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
 #include <stdint.h>
 
 void typeout_pc(struct job *j);
-void step_job(struct job *j);
+int step_job(struct job *j, uint64_t n);
+void trace(char *arg);
+int stepover_job(struct job *j);
+int stepout_job(struct job *j);
+int cont_job(struct job *j);
+int cont_syscall(struct job *j);
+int detach_job(struct job *j);
+int read_mem(struct job *j, uint64_t addr, void *buf, size_t len);
+int write_mem(struct job *j, uint64_t addr, const void *buf, size_t len);
+int flush_mem(struct job *j);
+int patch_mem(struct job *j, uint64_t addr, const void *buf, size_t len);
+struct user_regs_struct *job_regs(struct job *j);
+struct user_fpregs_struct *job_fpregs(struct job *j);
+void *job_xstate(struct job *j, size_t *len);
+int set_pc(struct job *j, uint64_t pc);
+int reg_value(struct job *j, const char *name, size_t len, uint64_t *v);
+void release_regs(struct job *j);
+long remote_syscall(struct job *j, long nr, long a1, long a2, long a3,
+		    long a4, long a5, long a6);
+int set_mar(struct job *j, uint64_t addr, int mode);
+int clear_mars(struct job *j);
+void list_mars(struct job *j);
+int mar_trap(struct job *j);
+int job_trap(struct job *j, int status);
+
+#define STOP_SIGNAL 0		/* not DDT's trap, type the signal */
+#define STOP_TRAP 1		/* typed out, the job stays stopped */
+#define STOP_RESUMED 2		/* handled, the job is running again */
+const char *job_symbol(struct job *j, uint64_t addr, uint64_t *off);
+int job_symvalue(struct job *j, const char *name, size_t len, uint64_t *value);
+struct regions *job_regions(struct job *j);
+void refresh_regions(struct job *j);
+struct region *find_region(struct regions *rs, uint64_t addr);
+void release_regions(struct regions *rs);
+void invalidate_mem(struct job *j);
+void release_mem(struct job *j);
 int ptrace_seize(pid_t pid);
 int ptrace_detach(pid_t pid);
 int ptrace_interrupt(pid_t pid);
 int ptrace_setopts(pid_t pid, int opts);
 int ptrace_cont(pid_t pid);
 
-void load_symbols(struct job *j);
+void load_symbols(struct job *j, int fd);
 void unload_symbols(struct job *j);
 void listp(char *);
 void lists(char *);
@@ -42,7 +77,9 @@ void resetradix(void);
 void setradix(int r, int perm);
 void settypeo(typeoutfunc *f, int perm);
 void resettypeo(void);
-int openlocation(pid_t pid, uint64_t addr);
+int openlocation(struct job *j, uint64_t addr);
 void closelocation(void);
+uint64_t nextlocation(void);
+int depositlocation(struct job *j, uint64_t value);
 
 extern uint64_t qreg;
@@ -18,8 +18,10 @@ along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <errno.h>
 #include "term.h"
 #include "ccmd.h"
 #include "jobs.h"
@@ -27,6 +29,11 @@ along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
 #include "debugger.h"
 #include "aeval.h"
 #include "typeout.h"
+#include "search.h"
+#include "dump.h"
+#include "bpt.h"
+#include "raid.h"
+#include "perf.h"
 
 #define PREFIX_MAXBUF 255
 #define SUFFIX_MAXBUF 255
@@ -52,6 +59,7 @@ static void (*alt[256]) (void);
 #define ALTMODE 033
 #define RUBOUT 0177
 #define CTRL_(c)	((c)-64)
+#define ALT_(c)		((c)|0x80)
 
 static void echo (int ch)
 {
@@ -262,8 +270,10 @@ static void raid (void)
 {
   if (altmodes > 1)
     listj(NULL);
+  else if (!currjob || !currjob->proc.pid)
+    fputs(" job? ", stderr);
   else
-    fprintf(stderr, "\r\na raid command %s\r\n", prefix);
+    raid_cmd(currjob, prefix, arg4str);
   done = 1;
 }
 
@@ -321,15 +331,40 @@ static void job (void)
   done = 1;
 }
 
+/* <n>$P at a breakpoint sets its proceed count, $$P makes it
+   auto-proceeding.  Returns 0 if the prefix did not parse. */
+static int proceedcount (void)
+{
+  struct bpt *b;
+  uint64_t n = 1;
+  char *r;
+
+  if (nprefix && (!(r = evalexpr(prefix, &n)) || *r))
+    return 0;
+  if (!currjob || currjob->state != 'p'
+      || !(b = find_bpt(&currjob->proc.bpts, currjob->proc.bpts.at)))
+    return 1;
+  b->count = n ? n : 1;
+  if (altmodes > 1)
+    b->flags |= BPT_AUTO;
+  return 1;
+}
+
 static void cont (void)
 {
-  contin(NULL);
+  if (proceedcount())
+    contin(NULL);
+  else
+    fputs("?? ", stderr);
   done = 1;
 }
 
 static void proceed (void)
 {
-  proced(NULL);
+  if (proceedcount())
+    proced(NULL);
+  else
+    fputs("?? ", stderr);
   done = 1;
 }
 
@@ -421,7 +456,7 @@ void kreat (void)
     run_(prefix, NULL, 0, altmodes);
   else if (altmodes == 1)
     {
-      load_symbols(currjob);
+      load_symbols(currjob, -1);
       fputs("\r\n", stderr);
     }
   else
@@ -539,6 +574,41 @@ static void settmh (void)
   fn = plain;
 }
 
+static void settms (void)
+{
+  if (altmodes--)
+      fputs("   ", stderr);
+
+  settypeo(tms, altmodes);
+
+  altmodes = 0;
+  fn = plain;
+}
+
+/* $% and $& select the current job's % and & modes, symbolic unless
+   changed. */
+static void settmperce (void)
+{
+  if (altmodes--)
+      fputs("   ", stderr);
+
+  settypeo(currjob ? currjob->tperce : mperce, altmodes);
+
+  altmodes = 0;
+  fn = plain;
+}
+
+static void settmamper (void)
+{
+  if (altmodes--)
+      fputs("   ", stderr);
+
+  settypeo(currjob ? currjob->tamper : mamper, altmodes);
+
+  altmodes = 0;
+  fn = plain;
+}
+
 static void chquote (void)
 {
   character = term_read();
@@ -550,12 +620,13 @@ static void chquote (void)
     }
 }
 
-static void step (void)
+/* Nonzero if the current job can be stepped, else complain. */
+static int steppable (void)
 {
   if (!currjob)
     {
       fputs(" job? ", stderr);
-      return;
+      return 0;
     }
 
   switch (currjob->state)
@@ -567,13 +638,288 @@ static void step (void)
       fputs(" not started? ", stderr);
       break;
     case 'p':
-      fputs("\r\n", stderr);
-      step_job(currjob);
-      typeout_pc(currjob);
-      break;
+      return 1;
     default:
       fputs(" not appropriate? ", stderr);
     }
+  return 0;
+}
+
+/* ^N steps one instruction, <n>^N that many. */
+static void step (void)
+{
+  uint64_t n = 1;
+  char *r;
+
+  if (nprefix && (!(r = evalexpr(prefix, &n)) || *r))
+    fputs("?? ", stderr);
+  else if (steppable())
+    {
+      fputs("\r\n", stderr);
+      int typed = step_job(currjob, n);
+      if (currjob->state == 'p')
+	{
+	  if (!typed)
+	    typeout_pc(currjob);
+	  counters_stop(currjob);
+	  raid_stop(currjob, typed ? "" : "\r\n");
+	}
+    }
+  resetargs();
+}
+
+/* $^N steps over a call, $$^N runs until the current function
+   returns, <pc>$^N runs until the pc gets to <pc>.  All of them
+   plant a one-shot breakpoint and proceed the job. */
+static void stepover (void)
+{
+  uint64_t pc;
+  char *r;
+  int n;
+
+  if (!steppable())
+    goto leave;
+  if (nprefix)
+    {
+      if (!(r = evalexpr(prefix, &pc)) || *r)
+	{
+	  fputs("?? ", stderr);
+	  goto leave;
+	}
+      n = set_tbpt(currjob, pc, 0) ? 1 : -1;
+    }
+  else if (altmodes > 1)
+    n = stepout_job(currjob) ? 1 : -1;
+  else
+    n = stepover_job(currjob);
+
+  if (n < 0)
+    errout("step");
+  else if (n)
+    contin(NULL);
+  else
+    {
+      fputs("\r\n", stderr);
+      int typed = step_job(currjob, 1);
+      if (currjob->state == 'p')
+	{
+	  if (!typed)
+	    typeout_pc(currjob);
+	  counters_stop(currjob);
+	  raid_stop(currjob, typed ? "" : "\r\n");
+	}
+    }
+
+ leave:
+  resetargs();
+  done = 1;
+}
+
+/* Evaluate the $, separated arguments of the prefix into args.
+   Returns how many there were, or -1 if one did not parse. */
+static int prefixargs (uint64_t *args, int max)
+{
+  char buf[PREFIX_MAXBUF+1];
+  char *p = buf;
+  int n = 0;
+
+  strcpy(buf, prefix);
+  while (n < max)
+    {
+      char *sep = strchr(p, ALT_(','));
+      char *r;
+      if (sep)
+	*sep = 0;
+      if (!(r = evalexpr(p, &args[n])) || *r)
+	return -1;
+      n++;
+      if (!sep)
+	break;
+      p = sep + 1;
+    }
+  return n;
+}
+
+static uint64_t searchmask (void)
+{
+  if (!narg4)
+    return masks[0];
+
+  uint64_t n = strtoull(arg4str, NULL, 10);
+  return n < NMASKS ? masks[n] : n;
+}
+
+static void wsearch (int how)
+{
+  uint64_t args[3];
+  uint64_t lo = 0, hi = -1;
+  int n;
+
+  if (!nprefix || (n = prefixargs(args, 3)) < 0)
+    {
+      fputs("?? ", stderr);
+      done = 1;
+      return;
+    }
+  if (n > 1)
+    lo = args[0];
+  if (n > 2)
+    hi = args[1];
+
+  search(currjob, how, args[n-1], searchmask(), lo, hi);
+  done = 1;
+}
+
+static void wordsearch (void)
+{
+  wsearch(SEARCH_EQ);
+}
+
+static void notsearch (void)
+{
+  wsearch(SEARCH_NE);
+}
+
+static void easearch (void)
+{
+  wsearch(SEARCH_EA);
+}
+
+static void setmask (void)
+{
+  uint64_t n = narg4 ? strtoull(arg4str, NULL, 10) : 0;
+  uint64_t mask;
+  char *r;
+
+  if (n >= NMASKS)
+    fputs("?? ", stderr);
+  else if (!nprefix)
+    {
+      fputs("   ", stderr);
+      tmc(masks[n]);
+    }
+  else if ((r = evalexpr(prefix, &mask)) && !*r)
+    masks[n] = mask;
+  else
+    fputs("?? ", stderr);
+  resetargs();
+}
+
+/* $B and its variants, see ddtord. */
+static void brkpt (void)
+{
+  struct job *j = currjob;
+  int n = narg4 ? atoi(arg4str) : -1;
+  uint64_t loc;
+  char *r;
+  int ok;
+
+  if (!j || !j->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      resetargs();
+      return;
+    }
+  if (!nprefix)
+    {
+      if (altmodes > 1)
+	ok = clear_bpts(j);
+      else if (j->proc.bpts.at)
+	ok = clear_bpt(j, j->proc.bpts.at);
+      else
+	{
+	  fputs(" not at a breakpoint? ", stderr);
+	  resetargs();
+	  return;
+	}
+    }
+  else if (!(r = evalexpr(prefix, &loc)) || *r)
+    {
+      fputs("?? ", stderr);
+      resetargs();
+      return;
+    }
+  else if (n == 0)
+    ok = clear_bpt(j, loc);
+  else if (loc == 0 && n > 0)
+    ok = clear_bptn(j, n);
+  else
+    ok = set_bpt(j, loc, n > 0 ? n : 0, altmodes > 1 ? BPT_AUTO : 0);
+
+  if (ok)
+    fputs("   ", stderr);
+  else if (errno == ENOENT)
+    fputs(" no breakpoint? ", stderr);
+  else
+    errout("breakpoint");
+  resetargs();
+}
+
+/* $I clears the MARs, <loc>$<n>I sets one, $$I lists them. */
+static void mar (void)
+{
+  uint64_t loc;
+  int mode = narg4 ? atoi(arg4str) : 3;
+  char *r;
+
+  if (!currjob || !currjob->proc.pid)
+    fputs(" job? ", stderr);
+  else if (currjob->state == 'r')
+    fputs(" job running? ", stderr);
+  else if (altmodes > 1)
+    list_mars(currjob);
+  else if (!nprefix)
+    {
+      if (!clear_mars(currjob))
+	errout("mar");
+      else
+	fputs("   ", stderr);
+    }
+  else if (mode > 3 || !(r = evalexpr(prefix, &loc)) || *r)
+    fputs("?? ", stderr);
+  else if (!set_mar(currjob, loc, mode))
+    {
+      if (errno == ENOSPC)
+	fprintf(stderr, " %d MARs already? ", NMAR);
+      else if (errno == ENOENT)
+	fputs(" no MAR there? ", stderr);
+      else
+	errout("mar");
+    }
+  else
+    fputs("   ", stderr);
+  resetargs();
+}
+
+static void ydump (void)
+{
+  uint64_t args[2];
+  uint64_t lo = 0, hi = -1;
+  int n = 0;
+
+  if (nprefix && (n = prefixargs(args, 2)) != 2)
+    {
+      fputs("?? ", stderr);
+      done = 1;
+      return;
+    }
+  if (n == 2)
+    {
+      lo = args[0];
+      hi = args[1];
+    }
+
+  fputs(" ", stderr);
+  char *cmdline = suffix();
+  if (cmdline != NULL && *cmdline)
+    {
+      while (*cmdline == ' ')
+	cmdline++;
+      dump_job(currjob, cmdline, lo, hi);
+    }
+  else
+    fputs("?? ", stderr);
+  done = 1;
 }
 
 void opennum (void)
@@ -592,7 +938,7 @@ void opennum (void)
   else
     n = qreg;
 
-  if (openlocation(currjob ? currjob->proc.pid : 0, n))
+  if (openlocation(currjob, n))
     {
       fputs("   ", stderr);
       tmc(qreg);
@@ -602,11 +948,66 @@ void opennum (void)
   resetargs();
 }
 
-void carret (void)
+/* / opens a location like [, typing it in the current mode. */
+static void opensch (void)
 {
-  if (nprefix)
-    fprintf(stderr, "\r\nWould deposit arg\r\n");
+  uint64_t n;
+  char *r;
+
+  if (!nprefix)
+    n = qreg;
+  else if (!(r = evalexpr(prefix, &n)) || *r)
+    {
+      fputs("?? ", stderr);
+      goto leave;
+    }
+  if (openlocation(currjob, n))
+    {
+      fputs("   ", stderr);
+      sch(qreg);
+    }
 
+ leave:
+  resetargs();
+}
+
+static int deposit (void)
+{
+  uint64_t n;
+  char *r;
+
+  if (!nprefix)
+    return 1;
+
+  if (!(r = evalexpr(prefix, &n)) || *r)
+    {
+      fputs("?? ", stderr);
+      return 0;
+    }
+  return depositlocation(currjob, n);
+}
+
+static void linefeed (void)
+{
+  if (!deposit())
+    {
+      done = 1;
+      return;
+    }
+
+  uint64_t n = nextlocation();
+
+  fputs("\r\n", stderr);
+  outsym(currjob, n);
+  fputs("/   ", stderr);
+  if (openlocation(currjob, n))
+    sch(qreg);
+  done = 1;
+}
+
+void carret (void)
+{
+  deposit();
   closelocation();
   resettypeo();
 }
@@ -643,10 +1044,12 @@ void dispatch_init (void)
   plain[BACKSPACE] = backspace;
   plain[CTRL_('K')] = kreat;
   alt[CTRL_('K')] = kreat;
+  plain[CTRL_('J')] = linefeed;
   plain[FORMFEED] = formfeed;
   alt[FORMFEED] = formfeed;
   plain[CTRL_('M')] = carret;
   plain[CTRL_('N')] = step;
+  alt[CTRL_('N')] = stepover;
   plain[CTRL_('P')] = proceed;
   plain[CTRL_('Q')] = chquote;
   plain[CTRL_('R')] = print;
@@ -674,25 +1077,36 @@ void dispatch_init (void)
   alt['!'] = altarg;
   plain['#'] = nmsgn;
   plain['&'] = amper;
+  alt['&'] = settmamper;
+  alt['%'] = settmperce;
 
   plain['['] = opennum;
+  plain['/'] = opensch;
 
   plain[':'] = colon;
   alt[':'] = colon;
   plain['='] = equal;
   alt['='] = equal;
 
+  alt['b'] = brkpt;
   alt['c'] = settmc;
   alt['d'] = radix10;
+  alt['e'] = easearch;
   alt['f'] = settmf;
   alt['g'] = start;
   alt['h'] = settmh;
+  alt['i'] = mar;
   alt['j'] = job;
   alt['l'] = load;
+  alt['m'] = setmask;
+  alt['n'] = notsearch;
   alt['o'] = radix8;
   alt['p'] = cont;
+  alt['s'] = settms;
   alt['u'] = login;
   alt['v'] = raid;
+  alt['w'] = wordsearch;
+  alt['y'] = ydump;
   alt['X'] = radix16;
   alt['?'] = print_args;
 
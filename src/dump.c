@@ -0,0 +1,475 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <elf.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/ptrace.h>
+#include <sys/procfs.h>
+#include <sys/user.h>
+#include "jobs.h"
+#include "debugger.h"
+#include "dump.h"
+
+#define BATCH (4 << 20)
+#define MAXWORKERS 8
+#define NOTE_ALIGN(n) (((n) + 3) & ~3)
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int zeropage(const char *page)
+{
+  const uint64_t *w = (const uint64_t *)page;
+  uint64_t acc = 0;
+
+  for (int i = 0; i < MEMPAGE / sizeof(uint64_t); i += 8)
+    {
+      acc |= w[i] | w[i+1] | w[i+2] | w[i+3] | w[i+4] | w[i+5] | w[i+6] | w[i+7];
+      if (acc)
+	return 0;
+    }
+  return 1;
+}
+
+/* Copy start..end of pid's memory to fd at offset, in BATCH sized
+   process_vm_readv calls through buf.  Runs of nonzero pages are
+   written with one pwrite each; zero pages and pages that cannot be
+   read are skipped, leaving holes.  Returns the number of bytes
+   written, or -1 if the file could not be written. */
+int64_t copy_region(pid_t pid, int fd, uint64_t start, uint64_t end,
+		    uint64_t offset, char *buf, uint32_t *unread)
+{
+  int64_t written = 0;
+
+  while (start < end)
+    {
+      size_t len = end - start < BATCH ? end - start : BATCH;
+      struct iovec local = { buf, len };
+      struct iovec remote = { (void *)start, len };
+      ssize_t n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+
+      if (n <= 0)
+	{
+	  start += MEMPAGE;
+	  offset += MEMPAGE;
+	  (*unread)++;
+	  continue;
+	}
+
+      for (ssize_t i = 0; i < n; )
+	{
+	  if (zeropage(buf + i))
+	    {
+	      i += MEMPAGE;
+	      continue;
+	    }
+	  ssize_t k = i + MEMPAGE;
+	  while (k < n && !zeropage(buf + k))
+	    k += MEMPAGE;
+	  if (pwrite(fd, buf + i, k - i, offset + i) != k - i)
+	    return -1;
+	  written += k - i;
+	  i = k;
+	}
+      start += n;
+      offset += n;
+    }
+  return written;
+}
+
+void dump_job(struct job *j, char *file, uint64_t lo, uint64_t hi)
+{
+  pid_t pid = (j && j->proc.pid) ? j->proc.pid : getpid();
+  struct regions *rs;
+  struct dumpent *ents;
+  struct dumphdr hdr = { DUMP_MAGIC, DUMP_VERSION, 0, MEMPAGE };
+  char *buf;
+  int fd;
+
+  if (j && j->state == 'r')
+    {
+      fputs(" job running? ", stderr);
+      return;
+    }
+  if (j && j->proc.pid && !flush_mem(j))
+    errout("deposit");
+  if (!j || !j->proc.pid)
+    refresh_regions(j);
+  if (!(rs = job_regions(j)))
+    {
+      errout("maps");
+      return;
+    }
+
+  if ((ents = calloc(rs->n, sizeof(struct dumpent))) == NULL
+      || (buf = malloc(BATCH)) == NULL)
+    {
+      free(ents);
+      errout("dump");
+      return;
+    }
+
+  lo &= ~(uint64_t)(MEMPAGE - 1);
+  for (int i = 0; i < rs->n; i++)
+    {
+      struct region *r = &rs->r[i];
+      if (!(r->prot & PROT_READ) || r->end <= lo || r->start >= hi)
+	continue;
+      ents[hdr.nregions].start = r->start < lo ? lo : r->start;
+      ents[hdr.nregions].end = r->end > hi ? (hi | (MEMPAGE - 1)) + 1 : r->end;
+      ents[hdr.nregions].prot = r->prot;
+      hdr.nregions++;
+    }
+
+  uint64_t offset = sizeof(hdr) + hdr.nregions * sizeof(struct dumpent);
+  offset = (offset + MEMPAGE - 1) & ~(uint64_t)(MEMPAGE - 1);
+  for (int i = 0; i < hdr.nregions; i++)
+    {
+      ents[i].offset = offset;
+      offset += ents[i].end - ents[i].start;
+    }
+
+  errno = 0;
+  if ((fd = openat(msname.fd, file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+    {
+      errout(file);
+      goto out;
+    }
+
+  double t0 = now();
+  int64_t data = 0;
+  uint64_t total = 0;
+
+  for (int i = 0; i < hdr.nregions; i++)
+    {
+      int64_t n = copy_region(pid, fd, ents[i].start, ents[i].end,
+			      ents[i].offset, buf, &ents[i].unread);
+      if (n < 0)
+	{
+	  errout(file);
+	  goto close;
+	}
+      data += n;
+      total += ents[i].end - ents[i].start;
+    }
+
+  if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+      || pwrite(fd, ents, hdr.nregions * sizeof(struct dumpent), sizeof(hdr))
+	 != hdr.nregions * sizeof(struct dumpent)
+      || ftruncate(fd, offset) == -1)
+    {
+      errout(file);
+      goto close;
+    }
+
+  double dt = now() - t0;
+  fprintf(stderr, "\r\n%d regions, %.1f MB, %.1f MB nonzero, in %.2f s\r\n",
+	  hdr.nregions, total / 1048576.0, data / 1048576.0, dt);
+
+ close:
+  close(fd);
+ out:
+  free(buf);
+  free(ents);
+}
+
+/* :pdump writes an ELF core file of a stopped job without disturbing
+   it: a PT_NOTE segment with the usual prstatus, prpsinfo, fpregset
+   and auxv notes, then a PT_LOAD segment for each mapping.  The
+   mappings are copied by a few worker threads at once. */
+
+struct note {
+  char *buf;
+  size_t len;
+  size_t max;
+};
+
+static int addnote(struct note *n, uint32_t type, const void *desc, size_t len)
+{
+  Elf64_Nhdr nh = { sizeof("CORE"), len, type };
+  size_t need = sizeof(nh) + NOTE_ALIGN(sizeof("CORE")) + NOTE_ALIGN(len);
+
+  if (n->len + need > n->max)
+    {
+      size_t max = 2 * (n->len + need);
+      char *p = realloc(n->buf, max);
+      if (!p)
+	return 0;
+      n->buf = p;
+      n->max = max;
+    }
+  char *p = n->buf + n->len;
+  memset(p, 0, need);
+  memcpy(p, &nh, sizeof(nh));
+  memcpy(p + sizeof(nh), "CORE", sizeof("CORE"));
+  memcpy(p + sizeof(nh) + NOTE_ALIGN(sizeof("CORE")), desc, len);
+  n->len += need;
+  return 1;
+}
+
+static ssize_t readproc(pid_t pid, const char *what, char *buf, size_t len)
+{
+  char path[64];
+  ssize_t n, total = 0;
+  int fd;
+
+  snprintf(path, sizeof(path), "/proc/%d/%s", pid, what);
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+    return -1;
+  while (total < len && (n = read(fd, buf + total, len - total)) > 0)
+    total += n;
+  close(fd);
+  return total;
+}
+
+static int corenotes(struct job *j, struct note *n)
+{
+  pid_t pid = j->proc.pid;
+  struct elf_prstatus prs = { 0 };
+  struct elf_prpsinfo psi = { 0 };
+  struct user_regs_struct *regs;
+  struct user_fpregs_struct *fpregs;
+  char auxv[4096];
+  ssize_t len;
+
+  if (!(regs = job_regs(j)))
+    return 0;
+
+  prs.pr_pid = pid;
+  prs.pr_ppid = getpid();
+  prs.pr_pgrp = getpgid(pid);
+  prs.pr_sid = getsid(pid);
+  prs.pr_cursig = WSTOPSIG(j->proc.status);
+  memcpy(&prs.pr_reg, regs, sizeof(*regs));
+  prs.pr_fpvalid = (fpregs = job_fpregs(j)) != NULL;
+
+  psi.pr_state = 3;
+  psi.pr_sname = 'T';
+  psi.pr_pid = pid;
+  psi.pr_ppid = getpid();
+  psi.pr_pgrp = prs.pr_pgrp;
+  psi.pr_sid = prs.pr_sid;
+  psi.pr_uid = getuid();
+  psi.pr_gid = getgid();
+  if ((len = readproc(pid, "comm", psi.pr_fname, sizeof(psi.pr_fname) - 1)) > 0)
+    psi.pr_fname[strcspn(psi.pr_fname, "\n")] = 0;
+  if ((len = readproc(pid, "cmdline", psi.pr_psargs, sizeof(psi.pr_psargs) - 1)) > 0)
+    for (ssize_t i = 0; i < len - 1; i++)
+      if (!psi.pr_psargs[i])
+	psi.pr_psargs[i] = ' ';
+
+  if (!addnote(n, NT_PRSTATUS, &prs, sizeof(prs))
+      || !addnote(n, NT_PRPSINFO, &psi, sizeof(psi))
+      || (prs.pr_fpvalid && !addnote(n, NT_FPREGSET, fpregs, sizeof(*fpregs))))
+    return 0;
+  if ((len = readproc(pid, "auxv", auxv, sizeof(auxv))) > 0
+      && !addnote(n, NT_AUXV, auxv, len))
+    return 0;
+  return 1;
+}
+
+struct pdumpwork {
+  pid_t pid;
+  int fd;
+  Elf64_Phdr *ph;
+  int nph;
+  int next;			/* next PT_LOAD to take */
+  int failed;
+  int64_t written;
+  uint32_t unread;
+};
+
+static void *pdump_worker(void *arg)
+{
+  struct pdumpwork *w = arg;
+  char *buf = malloc(BATCH);
+  uint32_t unread = 0;
+  int64_t written = 0;
+  int i;
+
+  if (!buf)
+    {
+      __atomic_store_n(&w->failed, 1, __ATOMIC_RELAXED);
+      return NULL;
+    }
+
+  while ((i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED)) < w->nph)
+    {
+      Elf64_Phdr *ph = &w->ph[i];
+      if (!ph->p_filesz)
+	continue;
+      int64_t n = copy_region(w->pid, w->fd, ph->p_vaddr, ph->p_vaddr + ph->p_filesz,
+			      ph->p_offset, buf, &unread);
+      if (n < 0)
+	{
+	  __atomic_store_n(&w->failed, 1, __ATOMIC_RELAXED);
+	  break;
+	}
+      written += n;
+    }
+
+  __atomic_fetch_add(&w->written, written, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&w->unread, unread, __ATOMIC_RELAXED);
+  free(buf);
+  return NULL;
+}
+
+void pdump(char *file)
+{
+  struct job *j = currjob;
+  struct regions *rs;
+  struct note notes = { 0 };
+  Elf64_Phdr *ph = NULL;
+  pthread_t workers[MAXWORKERS];
+  int nworkers = 0;
+  int fd = -1;
+
+  if (!j || !j->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  if (j->state == 'r')
+    {
+      fputs(" job running? ", stderr);
+      return;
+    }
+  if (!file || !*file)
+    {
+      fputs(" file? ", stderr);
+      return;
+    }
+  if (!flush_mem(j))
+    errout("deposit");
+  if (!(rs = job_regions(j)))
+    {
+      errout("maps");
+      return;
+    }
+  if (!corenotes(j, &notes))
+    {
+      errout("pdump");
+      goto out;
+    }
+
+  int nph = rs->n + 1;
+  if ((ph = calloc(nph, sizeof(Elf64_Phdr))) == NULL)
+    {
+      errout("pdump");
+      goto out;
+    }
+
+  Elf64_Ehdr eh = { 0 };
+  memcpy(eh.e_ident, ELFMAG, SELFMAG);
+  eh.e_ident[EI_CLASS] = ELFCLASS64;
+  eh.e_ident[EI_DATA] = ELFDATA2LSB;
+  eh.e_ident[EI_VERSION] = EV_CURRENT;
+  eh.e_ident[EI_OSABI] = ELFOSABI_NONE;
+  eh.e_type = ET_CORE;
+  eh.e_machine = EM_X86_64;
+  eh.e_version = EV_CURRENT;
+  eh.e_phoff = sizeof(eh);
+  eh.e_ehsize = sizeof(eh);
+  eh.e_phentsize = sizeof(Elf64_Phdr);
+  eh.e_phnum = nph;
+
+  uint64_t offset = sizeof(eh) + nph * sizeof(Elf64_Phdr);
+  ph[0].p_type = PT_NOTE;
+  ph[0].p_offset = offset;
+  ph[0].p_filesz = notes.len;
+  ph[0].p_align = 4;
+  offset = (offset + notes.len + MEMPAGE - 1) & ~(uint64_t)(MEMPAGE - 1);
+
+  uint64_t total = 0;
+  for (int i = 0; i < rs->n; i++)
+    {
+      struct region *r = &rs->r[i];
+      Elf64_Phdr *p = &ph[i + 1];
+      p->p_type = PT_LOAD;
+      p->p_vaddr = r->start;
+      p->p_memsz = r->end - r->start;
+      p->p_filesz = (r->prot & PROT_READ) ? p->p_memsz : 0;
+      p->p_offset = offset;
+      p->p_align = MEMPAGE;
+      p->p_flags = ((r->prot & PROT_READ) ? PF_R : 0)
+	| ((r->prot & PROT_WRITE) ? PF_W : 0)
+	| ((r->prot & PROT_EXEC) ? PF_X : 0);
+      offset += p->p_filesz;
+      total += p->p_filesz;
+    }
+
+  errno = 0;
+  if ((fd = openat(msname.fd, file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+    {
+      errout(file);
+      goto out;
+    }
+
+  double t0 = now();
+
+  struct pdumpwork w = { j->proc.pid, fd, ph + 1, rs->n, 0, 0, 0, 0 };
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int want = ncpu < 1 ? 1 : ncpu > MAXWORKERS ? MAXWORKERS : ncpu;
+  if (want > rs->n)
+    want = rs->n;
+  for (int i = 0; i < want; i++)
+    if (pthread_create(&workers[nworkers], NULL, pdump_worker, &w) == 0)
+      nworkers++;
+  if (!nworkers)
+    pdump_worker(&w);
+  for (int i = 0; i < nworkers; i++)
+    pthread_join(workers[i], NULL);
+
+  if (w.failed
+      || pwrite(fd, &eh, sizeof(eh), 0) != sizeof(eh)
+      || pwrite(fd, ph, nph * sizeof(Elf64_Phdr), sizeof(eh)) != nph * sizeof(Elf64_Phdr)
+      || pwrite(fd, notes.buf, notes.len, ph[0].p_offset) != notes.len
+      || ftruncate(fd, offset) == -1)
+    {
+      errout(file);
+      goto out;
+    }
+
+  double dt = now() - t0;
+  fprintf(stderr, "\r\n%d segments, %.1f MB, %.1f MB nonzero, %d threads, in %.2f s\r\n",
+	  rs->n, total / 1048576.0, w.written / 1048576.0, nworkers ? nworkers : 1, dt);
+  if (w.unread)
+    fprintf(stderr, "%u pages unreadable\r\n", w.unread);
+
+ out:
+  if (fd != -1)
+    close(fd);
+  free(ph);
+  free(notes.buf);
+}
@@ -0,0 +1,44 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* $Y dump file: a header and index of the dumped regions, then
+   each region's contents at its offset, zero pages left as holes. */
+
+#define DUMP_MAGIC "DDTDUMP"
+#define DUMP_VERSION 1
+
+struct dumphdr {
+  char magic[8];
+  uint32_t version;
+  uint32_t nregions;
+  uint64_t pagesize;
+};
+
+struct dumpent {
+  uint64_t start;
+  uint64_t end;
+  uint64_t offset;		/* in the file */
+  uint32_t prot;
+  uint32_t unread;		/* pages that could not be read */
+};
+
+void dump_job(struct job *j, char *file, uint64_t lo, uint64_t hi);
+void pdump(char *file);
+int64_t copy_region(pid_t pid, int fd, uint64_t start, uint64_t end,
+		    uint64_t offset, char *buf, uint32_t *unread);
@@ -0,0 +1,236 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "elffile.h"
+
+/* ELF files.  Opening one reads only its file header, section headers
+   and program headers; a section's contents are mapped the first time
+   they are asked for, so looking at the symbol table of a file of
+   several gigabytes of debug information maps the symbol table and
+   its strings and nothing else.  A copy already in memory, as of the
+   vDSO, is read the same way. */
+
+#define DEBUGDIR "/usr/lib/debug/.build-id"
+
+static int readhdrs(struct elffile *f, void *buf, size_t len, size_t off)
+{
+  if (off > f->size || len > f->size - off)
+    return 0;
+  if (f->fd == -1)
+    {
+      memcpy(buf, f->mem + off, len);
+      return 1;
+    }
+  return pread(f->fd, buf, len, off) == len;
+}
+
+static struct elffile *elf_init(struct elffile *f)
+{
+  Elf64_Ehdr *eh = &f->ehdr;
+
+  if (!readhdrs(f, eh, sizeof(*eh), 0) || memcmp(eh->e_ident, ELFMAG, SELFMAG)
+      || eh->e_ident[EI_CLASS] != ELFCLASS64
+      || (eh->e_shnum && eh->e_shentsize != sizeof(Elf64_Shdr))
+      || (eh->e_phnum && eh->e_phentsize != sizeof(Elf64_Phdr))
+      || !(f->shdr = calloc(eh->e_shnum + 1, sizeof(Elf64_Shdr)))
+      || !(f->phdr = calloc(eh->e_phnum + 1, sizeof(Elf64_Phdr)))
+      || !(f->map = calloc(eh->e_shnum + 1, sizeof(char *)))
+      || !(f->maplen = calloc(eh->e_shnum + 1, sizeof(size_t)))
+      || !readhdrs(f, f->shdr, eh->e_shnum * sizeof(Elf64_Shdr), eh->e_shoff)
+      || !readhdrs(f, f->phdr, eh->e_phnum * sizeof(Elf64_Phdr), eh->e_phoff))
+    {
+      elf_close(f);
+      return NULL;
+    }
+  return f;
+}
+
+/* The ELF file open on fd, which it takes; NULL if it is not one. */
+struct elffile *elf_fdopen(int fd)
+{
+  struct elffile *f;
+  struct stat st;
+
+  if (fd == -1)
+    return NULL;
+  if (fstat(fd, &st) == -1 || !(f = calloc(1, sizeof(struct elffile))))
+    {
+      close(fd);
+      return NULL;
+    }
+  f->fd = fd;
+  f->size = st.st_size;
+  return elf_init(f);
+}
+
+/* Opens the ELF file at path, relative to dirfd. */
+struct elffile *elf_open(int dirfd, const char *path)
+{
+  return elf_fdopen(openat(dirfd, path, O_RDONLY | O_CLOEXEC));
+}
+
+/* The ELF image in mem, size bytes long, which elf_close() frees. */
+struct elffile *elf_copy(char *mem, size_t size)
+{
+  struct elffile *f;
+
+  if (!(f = calloc(1, sizeof(struct elffile))))
+    {
+      free(mem);
+      return NULL;
+    }
+  f->fd = -1;
+  f->mem = mem;
+  f->size = size;
+  return elf_init(f);
+}
+
+void elf_close(struct elffile *f)
+{
+  if (!f)
+    return;
+  for (int i = 0; f->map && i < f->ehdr.e_shnum; i++)
+    if (f->map[i] && f->fd != -1)
+      munmap(f->map[i], f->maplen[i]);
+  if (f->fd != -1)
+    close(f->fd);
+  else
+    free((char *)f->mem);
+  free(f->shdr);
+  free(f->phdr);
+  free(f->map);
+  free(f->maplen);
+  free(f);
+}
+
+/* The contents of section i, mapped if they are not yet; NULL if it
+   has none in the file. */
+const void *elf_section(struct elffile *f, int i)
+{
+  const Elf64_Shdr *sh;
+  size_t skew;
+
+  if (i <= 0 || i >= f->ehdr.e_shnum)
+    return NULL;
+  sh = &f->shdr[i];
+  if (sh->sh_type == SHT_NOBITS || !sh->sh_size
+      || sh->sh_offset > f->size || sh->sh_size > f->size - sh->sh_offset)
+    return NULL;
+  if (f->fd == -1)
+    return f->mem + sh->sh_offset;
+  skew = sh->sh_offset % sysconf(_SC_PAGESIZE);
+  if (!f->map[i])
+    {
+      char *p = mmap(0, sh->sh_size + skew, PROT_READ, MAP_PRIVATE,
+		     f->fd, sh->sh_offset - skew);
+      if (p == MAP_FAILED)
+	return NULL;
+      f->map[i] = p;
+      f->maplen[i] = sh->sh_size + skew;
+    }
+  return f->map[i] + skew;
+}
+
+/* The name of section i, "" if it has none. */
+const char *elf_secname(struct elffile *f, int i)
+{
+  const char *names = elf_section(f, f->ehdr.e_shstrndx);
+  const Elf64_Shdr *str = &f->shdr[f->ehdr.e_shstrndx];
+
+  if (!names || i < 0 || i >= f->ehdr.e_shnum
+      || f->shdr[i].sh_name >= str->sh_size
+      || !memchr(names + f->shdr[i].sh_name, 0, str->sh_size - f->shdr[i].sh_name))
+    return "";
+  return names + f->shdr[i].sh_name;
+}
+
+/* The first section of type called name, or of type if name is NULL;
+   0 if there is none. */
+int elf_find(struct elffile *f, int type, const char *name)
+{
+  for (int i = 1; i < f->ehdr.e_shnum; i++)
+    if (f->shdr[i].sh_type == type && (!name || !strcmp(elf_secname(f, i), name)))
+      return i;
+  return 0;
+}
+
+/* The length of f's GNU build-id, 0 if it has none, and where it is. */
+size_t elf_build_id(struct elffile *f, const uint8_t **id)
+{
+  for (int i = 1; i < f->ehdr.e_shnum; i++)
+    {
+      const char *p = f->shdr[i].sh_type == SHT_NOTE ? elf_section(f, i) : NULL;
+      size_t off = 0, end = p ? f->shdr[i].sh_size : 0;
+
+      while (off + sizeof(Elf64_Nhdr) <= end)
+	{
+	  const Elf64_Nhdr *nh = (const Elf64_Nhdr *)(p + off);
+	  size_t name = off + sizeof(Elf64_Nhdr);
+	  size_t desc = name + ((nh->n_namesz + 3) & ~3);
+	  size_t next = desc + ((nh->n_descsz + 3) & ~3);
+	  if (next > end)
+	    break;
+	  if (nh->n_type == NT_GNU_BUILD_ID && nh->n_namesz == 4
+	      && !memcmp(p + name, "GNU", 4) && nh->n_descsz)
+	    {
+	      *id = (const uint8_t *)p + desc;
+	      return nh->n_descsz;
+	    }
+	  off = next;
+	}
+    }
+  return 0;
+}
+
+/* f, or if it has been stripped of its symbol table the separate
+   debug file with the same build-id, in which case f is closed. */
+struct elffile *elf_debug_file(struct elffile *f)
+{
+  const uint8_t *id, *did;
+  size_t idlen;
+  char path[sizeof(DEBUGDIR) + 8 + 2 * 64];
+  struct elffile *d;
+  int n;
+
+  if (elf_find(f, SHT_SYMTAB, NULL)
+      || (idlen = elf_build_id(f, &id)) < 2 || idlen > 64)
+    return f;
+  n = sprintf(path, "%s/%02x/", DEBUGDIR, id[0]);
+  for (size_t i = 1; i < idlen; i++)
+    n += sprintf(path + n, "%02x", id[i]);
+  strcpy(path + n, ".debug");
+  if (!(d = elf_open(AT_FDCWD, path)))
+    return f;
+  if (elf_build_id(d, &did) != idlen || memcmp(id, did, idlen)
+      || !elf_find(d, SHT_SYMTAB, NULL))
+    {
+      elf_close(d);
+      return f;
+    }
+  elf_close(f);
+  return d;
+}
@@ -0,0 +1,41 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <elf.h>
+
+/* An ELF file read a piece at a time, see elffile.c. */
+struct elffile {
+  int fd;			/* -1 if it is a copy in memory */
+  const char *mem;		/* the copy */
+  size_t size;
+  Elf64_Ehdr ehdr;
+  Elf64_Shdr *shdr;		/* e_shnum of them */
+  Elf64_Phdr *phdr;		/* e_phnum of them */
+  char **map;			/* each section's mapping, once made */
+  size_t *maplen;
+};
+
+struct elffile *elf_fdopen(int fd);
+struct elffile *elf_open(int dirfd, const char *path);
+struct elffile *elf_copy(char *mem, size_t size);
+void elf_close(struct elffile *f);
+const void *elf_section(struct elffile *f, int i);
+const char *elf_secname(struct elffile *f, int i);
+int elf_find(struct elffile *f, int type, const char *name);
+size_t elf_build_id(struct elffile *f, const uint8_t **id);
+struct elffile *elf_debug_file(struct elffile *f);
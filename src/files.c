@@ -248,6 +248,19 @@ static void setdeffile(struct file *f)
   deffile.dirfd = f->dirfd;
 }
 
+/* Opens the file arg names, for reading, as print_file() would. */
+int open_file(char *arg)
+{
+  struct file parsed = { strdup(deffile.name), deffile.devfd, deffile.dirfd, -1 };
+  int fd = -1;
+
+  if (parse_fname(&parsed, arg) != NULL
+      && (fd = open_(parsed.dirfd, parsed.name, O_RDONLY)) == -1)
+    errout(parsed.name);
+  free(parsed.name);
+  return fd;
+}
+
 void delete_file(char *name)
 {
   struct file parsed = { strdup(deffile.name), deffile.devfd, deffile.dirfd, -1 };
@@ -30,6 +30,7 @@ void cwd(char *arg);
 void nfdir(char *arg);
 void ofdir(char *arg);
 void print_file(char *arg);
+int open_file(char *arg);
 void listf(char *arg);
 void list_files(char *arg, int setdefp);
 
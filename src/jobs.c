@@ -32,6 +32,13 @@ along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
 #include "term.h"
 #include "debugger.h"
 #include "typeout.h"
+#include "snap.h"
+#include "raid.h"
+#include "perf.h"
+#include "bpt.h"
+#include "tpoint.h"
+#include "record.h"
+#include "solib.h"
 
 #define MAXJOBS 8
 #define MAXARGS 256
@@ -186,10 +193,28 @@ static struct job *initslot(char slot, char *jname)
   j->proc.env = malloc(sizeof(char *) * 2);
   j->proc.env[0] = NULL;
   j->proc.env[1] = NULL;
-  j->proc.syms = 0;
-  j->proc.symlen = 0;
+  j->proc.syms = NULL;
+  j->proc.symidx = NULL;
+  j->proc.biaspid = 0;
+  j->proc.solibs = NULL;
   j->proc.pid = 0;
   j->proc.status = 0;
+  j->proc.mem.pages = NULL;
+  invalidate_mem(j);
+  memset(&j->proc.regs, 0, sizeof(j->proc.regs));
+  j->proc.regions.r = NULL;
+  j->proc.regions.n = j->proc.regions.max = 0;
+  j->proc.regions.valid = 0;
+  j->proc.runs = 0;
+  j->proc.snap = NULL;
+  j->proc.raid = NULL;
+  j->proc.counters = NULL;
+  memset(j->proc.mar, 0, sizeof(j->proc.mar));
+  memset(&j->proc.bpts, 0, sizeof(j->proc.bpts));
+  j->proc.trace = NULL;
+  j->proc.tring = NULL;
+  j->proc.strace = NULL;
+  j->proc.ntrace = 0;
   j->tperce = mperce;
   j->tamper = mamper;
   j->tdollar = mdolla;
@@ -232,38 +257,63 @@ static void free_job(struct job *j)
     close(j->proc.ufname.fd);
   if (j->proc.syms)
     unload_symbols(j);
+  release_solibs(j);
+  release_mem(j);
+  release_regions(&j->proc.regions);
+  record_exit(j, -1);
+  release_snap(j);
+  release_raid(j);
+  release_counters(j);
+  release_tring(j);
+  release_regs(j);
+  free(j->proc.strace);
+  j->proc.strace = NULL;
+  release_bpts(&j->proc.bpts);
+  free(j->proc.trace);
+  j->proc.trace = NULL;
 
   j->jname = 0;
   j->xjname = 0;
   j->jcl = 0;
   j->state = 0;
   j->proc.ufname.name = 0;
-  j->proc.syms = 0;
-  j->proc.symlen = 0;
+  j->proc.syms = NULL;
   j->proc.argv = 0;
 }
 
 static void jobwait(struct job *j, int expect, int sig)
 {
   int status = 0;
+  int trap;
 
+ again:
   waitpid(j->proc.pid, &status, WUNTRACED|WCONTINUED);
   if (WIFEXITED(status))
     {
       if (WEXITSTATUS(status))
 	fprintf(stderr, ":exit %d\r\n", WEXITSTATUS(status));
+      record_exit(j, status);
       free_job(j);
     }
   else if (WIFSIGNALED(status))
     {
       fprintf(stderr, ":kill %d\r\n", WTERMSIG(status));
+      record_exit(j, status);
       free_job(j);
     }
   else if (WIFSTOPPED(status))
     {
-      if (!(expect & EXPECT_STOP && sig == WSTOPSIG(status)))
+      trap = (WSTOPSIG(status) & 0x7f) == SIGTRAP ? job_trap(j, status) : STOP_SIGNAL;
+      if (trap == STOP_RESUMED)
+	goto again;
+      if (trap == STOP_SIGNAL)
+	record_signal(j, WSTOPSIG(status));
+      if (trap == STOP_SIGNAL && !(expect & EXPECT_STOP && sig == WSTOPSIG(status)))
 	fprintf(stderr, ":stop signal=%d\r\n", WSTOPSIG(status));
       j->state = 'p';
+      j->proc.status = status;
+      counters_stop(j);
+      raid_stop(j, "");
     }
   else
     fprintf(stderr, " wait status=%d\r\n", status);
@@ -279,7 +329,7 @@ static int kill_job(struct job *j)
       break;
     case '~':
     case 'p':
-      if (!ptrace_detach(j->proc.pid))
+      if (!detach_job(j))
 	errout("ptrace detach");
     case 'r':
       errno = 0;
@@ -453,9 +503,10 @@ static void load_(void)
       currjob->state = '~';
     }
 
-  if (!ptrace_setopts(childpid, PTRACE_O_TRACEEXEC))
+  if (!ptrace_setopts(childpid, PTRACE_O_TRACEEXEC | PTRACE_O_TRACESECCOMP
+		      | PTRACE_O_TRACESYSGOOD))
     errout("ptrace setoptions");
-  else if (!ptrace_cont(childpid))
+  else if (!cont_job(currjob))
     errout("ptrace cont");
 }
 
@@ -529,6 +580,42 @@ int fgwait(void)
   return 1;
 }
 
+/* Report a wait status of j that DDT was not waiting for. */
+void job_changed(struct job *j, int status)
+{
+  if (WIFEXITED(status))
+    {
+      fprintf(stderr, ":exit %d %s$j\r\n", WEXITSTATUS(status), j->jname);
+      record_exit(j, status);
+      free_job(j);
+    }
+  else if (WIFSIGNALED(status))
+    {
+      fprintf(stderr, ":kill %d %s$j\r\n", WTERMSIG(status), j->jname);
+      record_exit(j, status);
+      free_job(j);
+    }
+  else if (WIFSTOPPED(status))
+    {
+      int trap = STOP_SIGNAL;
+      if ((WSTOPSIG(status) & 0x7f) == SIGTRAP
+	  && (trap = job_trap(j, status)) == STOP_RESUMED)
+	return;
+      if (trap == STOP_SIGNAL)
+	{
+	  record_signal(j, WSTOPSIG(status));
+	  fprintf(stderr, ":stop signal=%d %s$j\r\n",
+		  WSTOPSIG(status), j->jname);
+	}
+      j->state = 'p';
+      j->proc.status = status;
+      counters_stop(j);
+      raid_stop(j, "");
+    }
+  else
+    fprintf(stderr, "check_jobs status=%d\r\n", status);
+}
+
 void check_jobs(void)
 {
   pid_t child;
@@ -541,25 +628,7 @@ void check_jobs(void)
 	{
 	  if (j->proc.pid == child)
 	    {
-	      if (WIFEXITED(status))
-		{
-		  fprintf(stderr, ":exit %d %s$j\r\n", WEXITSTATUS(status), j->jname);
-		  free_job(j);
-		}
-	      else if (WIFSIGNALED(status))
-		{
-		  fprintf(stderr, ":kill %d %s$j\r\n", WTERMSIG(status), j->jname);
-		  free_job(j);
-		}
-	      else if (WIFSTOPPED(status))
-		{
-		  fprintf(stderr, ":stop signal=%d %s$j\r\n",
-			  WSTOPSIG(status), j->jname);
-		  j->state = 'p';
-		}
-	      else
-		fprintf(stderr, "check_jobs status=%d\r\n", status);
-
+	      job_changed(j, status);
 	      break;
 	    }
 	}
@@ -597,7 +666,7 @@ void contin(char *unused)
     switch (currjob->state)
       {
       case 'p':
-	if (ptrace_cont(currjob->proc.pid))
+	if (cont_job(currjob))
 	  currjob->state = 'r';
 	else
 	  errout(currjob->proc.ufname.name);
@@ -618,7 +687,7 @@ void proced(char *unused)
     switch (currjob->state)
       {
       case 'p':
-	if (ptrace_cont(currjob->proc.pid))
+	if (cont_job(currjob))
 	  currjob->state = 'r';
 	else
 	  errout(currjob->proc.ufname.name);
@@ -642,7 +711,7 @@ void go(char *addr)
       case '~':
       case 'p':
 	crlf();
-	if (ptrace_cont(currjob->proc.pid))
+	if (cont_job(currjob))
 	  {
 	    currjob->state = 'r';
 	    setfg(currjob);
@@ -667,7 +736,7 @@ void gzp(char *addr)
       {
       case '~':
       case 'p':
-	if (ptrace_cont(currjob->proc.pid))
+	if (cont_job(currjob))
 	  currjob->state = 'r';
 	else
 	  errout(currjob->proc.ufname.name);
@@ -797,12 +866,12 @@ void run_(char *jname, char *arg, int genj, int loadsyms)
   currjob->proc.argv[0] = strdup(jname);
 
   if (loadsyms)
-    load_symbols(currjob);
+    load_symbols(currjob, -1);
 
   load_();
   jobwait(currjob, EXPECT_STOP, 5);
 
-  if (ptrace_cont(currjob->proc.pid))
+  if (cont_job(currjob))
     {
       currjob->state = 'r';
       setfg(currjob);
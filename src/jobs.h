@@ -18,18 +18,131 @@ along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
 */
 #include <stdint.h>
 #include <termios.h>
+#include <sys/user.h>
 #include "files.h"
 #include "typeout.h"
 
+#define MEMPAGE 4096
+#define MEMCACHE_PAGES 64
+
+struct memcache {
+  char *pages;			/* MEMCACHE_PAGES pages, direct mapped */
+  uint64_t tag[MEMCACHE_PAGES];	/* page address held by each slot */
+  uint16_t dlo[MEMCACHE_PAGES];	/* deposited bytes not yet written */
+  uint16_t dhi[MEMCACHE_PAGES];	/* back are dlo..dhi of the slot */
+  int ndirty;
+  uint64_t next;		/* where a sequential walk goes next */
+};
+
+struct region {
+  uint64_t start;
+  uint64_t end;
+  uint64_t offset;
+  uint64_t inode;
+  int prot;			/* PROT_ bits, REGION_SHARED */
+  char *name;			/* file or [heap] etc., NULL if anonymous */
+};
+
+#define REGION_SHARED 0x100
+
+struct regions {
+  struct region *r;		/* sorted by start, not overlapping */
+  int n;
+  int max;
+  unsigned runs;		/* value of proc.runs when parsed */
+  int valid;
+};
+
+struct bpt {
+  uint64_t addr;		/* 0 if the slot is free */
+  int n;			/* as in $<n>B */
+  int flags;
+  long count;			/* proceed count */
+  unsigned long hits;
+  uint8_t orig;			/* the byte under the int3 */
+  uint8_t len;			/* BPT_JMP: bytes displaced by the jmp */
+  uint8_t code[15];		/* BPT_JMP: and what they were */
+  uint64_t link;		/* BPT_COND: its int3, BPT_STUB: its bpt */
+  char *cond;			/* BPT_JMP: the expressions as typed */
+};
+
+#define BPT_AUTO 1		/* auto-proceeding, $$B */
+#define BPT_TEMP 2		/* only there for $^N */
+#define BPT_COND 4		/* a jmp to a trampoline testing cond */
+#define BPT_STUB 8		/* the int3 in such a trampoline */
+#define BPT_TRACE 16		/* a jmp to a trampoline logging, :tpoint */
+#define BPT_SOLIB 32		/* _dl_debug_state, see solib.c */
+#define BPT_JMP (BPT_COND | BPT_TRACE)
+
+struct bpts {
+  struct bpt *t;		/* open addressed, linear probing */
+  unsigned size;		/* power of two */
+  unsigned used;
+  uint64_t lo, hi;		/* bounds of the addresses in t */
+  uint64_t at;			/* breakpoint the job is stopped at */
+  uint64_t temp;		/* $^N stops here... */
+  uint64_t tempsp;		/* ...once rsp is at least this */
+  int njmp;			/* how many are BPT_JMP */
+  uint64_t tramp;		/* free space for trampolines... */
+  uint64_t trampend;		/* ...up to here */
+};
+
+#define TRACE_RING 16384	/* instructions ^N remembers */
+
+struct tracent {
+  uint64_t rip;
+  uint64_t rsp;
+  uint64_t flags;
+};
+
+#define REGS_GP 1		/* user_regs_struct, NT_PRSTATUS */
+#define REGS_FP 2		/* user_fpregs_struct, NT_PRFPREG */
+#define REGS_XSTATE 4		/* XSAVE area with AVX, NT_X86_XSTATE */
+#define XSTATE_SIZE 4096
+
+/* The registers of a stopped job, each set fetched when first
+   needed and written back before the job runs if DDT changed it. */
+struct regcache {
+  int valid;			/* REGS_ sets fetched */
+  int dirty;			/* REGS_ sets changed */
+  struct user_regs_struct gp;
+  struct user_fpregs_struct fp;
+  char *xstate;			/* XSTATE_SIZE, allocated when needed */
+  size_t xlen;			/* as much as the kernel filled */
+};
+
+#define NMAR 4			/* x86 has DR0-DR3 */
+
+struct mar {
+  uint64_t addr;
+  int mode;			/* as in <loc>$<n>I, 0 if unused */
+};
+
 struct process {
   // struct process *next;
   struct file ufname;
   char **argv;
   char **env;
-  char *syms;
-  size_t symlen;
+  struct elffile *syms;		/* where symbols come from, elffile.c */
+  struct symindex *symidx;	/* see symbols.c */
+  uint64_t symbias;		/* where a PIE executable is loaded... */
+  pid_t biaspid;		/* ...in this process */
+  struct solibs *solibs;	/* shared objects, see solib.c */
   pid_t pid;
   int status;
+  struct memcache mem;
+  struct regcache regs;
+  struct regions regions;
+  unsigned runs;		/* bumped each time the job is resumed */
+  struct snapshot *snap;	/* :snap baseline, see snap.c */
+  struct raids *raid;		/* $V, see raid.c */
+  struct counters *counters;	/* :counters, see perf.c */
+  struct mar mar[NMAR];
+  struct bpts bpts;
+  struct tracent *trace;		/* ring of TRACE_RING */
+  uint64_t ntrace;		/* instructions ever put in it */
+  struct tring *tring;		/* :tpoint log, see tpoint.c */
+  struct strace *strace;	/* :strace state, see strace.c */
 };
 
 struct job {
@@ -51,6 +164,7 @@ struct job {
 void jobs_init(void);
 int fgwait(void);
 void check_jobs(void);
+void job_changed(struct job *j, int status);
 void list_currjob(void);
 void next_job(void);
 void stop_currjob(void);
@@ -0,0 +1,355 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "jobs.h"
+#include "term.h"
+#include "profile.h"
+#include "perf.h"
+
+/* Profiling and counting with perf_event_open.  The kernel does the
+   work while the job runs, so unlike :profile it is never stopped.
+   Hardware events are used when the machine has a PMU the kernel
+   lets DDT at; otherwise, as in most VMs, only software ones. */
+
+#define RINGPAGES 64		/* data pages of the sample ring */
+#define DRAIN_MS 10
+
+static int perf_open(struct perf_event_attr *attr, pid_t pid, int group)
+{
+  attr->size = sizeof(struct perf_event_attr);
+  attr->exclude_hv = 1;
+  return syscall(SYS_perf_event_open, attr, pid, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+/* ^D stops sampling. */
+static int interrupted(void)
+{
+  struct pollfd p = { 0, POLLIN, 0 };
+
+  if (poll(&p, 1, DRAIN_MS) == 1 && (p.revents & POLLIN))
+    return term_read() == ('D' - 64);
+  return 0;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Moves the records in the ring into s, returning how many samples
+   were lost. */
+static uint64_t drain(struct perf_event_mmap_page *mp, struct samples *s)
+{
+  const char *data = (char *)mp + mp->data_offset;
+  uint64_t size = mp->data_size;
+  uint64_t head = __atomic_load_n(&mp->data_head, __ATOMIC_ACQUIRE);
+  uint64_t tail = mp->data_tail, lost = 0;
+  uint64_t rec[PERF_MAX_STACK_DEPTH + 8];
+
+  while (tail < head)
+    {
+      struct perf_event_header h;
+      uint64_t off = tail % size;
+
+      memcpy(&h, data + off, sizeof(h));
+      if (h.size > sizeof(rec) || !h.size)
+	break;
+      /* A record may wrap round the end of the ring. */
+      if (off + h.size <= size)
+	memcpy(rec, data + off, h.size);
+      else
+	{
+	  memcpy(rec, data + off, size - off);
+	  memcpy((char *)rec + size - off, data, h.size - (size - off));
+	}
+      tail += h.size;
+
+      /* header, ip, nr, ips[nr]; the chain has context markers,
+	 and starts again from the ip. */
+      if (h.type == PERF_RECORD_SAMPLE && s->n < s->max)
+	{
+	  uint64_t *pcs = s->pcs + s->n * s->stride;
+	  uint64_t nr = rec[2];
+	  int d = 0, ip = 0;
+
+	  pcs[d++] = rec[1];
+	  for (uint64_t k = 0; k < nr && 3 + k < h.size / 8 && d < s->stride; k++)
+	    {
+	      uint64_t pc = rec[3 + k];
+	      if (pc >= PERF_CONTEXT_MAX || !ip++)
+		continue;
+	      pcs[d++] = pc - 1;	/* in the call */
+	    }
+	  s->depth[s->n++] = d;
+	}
+      else if (h.type == PERF_RECORD_SAMPLE)
+	lost++;
+      else if (h.type == PERF_RECORD_LOST)
+	lost += rec[2];
+    }
+  __atomic_store_n(&mp->data_tail, tail, __ATOMIC_RELEASE);
+  return lost;
+}
+
+/* :sample [<seconds> [<hz> [<file>]]] */
+void sample(char *arg)
+{
+  struct perf_event_attr attr = { 0 };
+  struct perf_event_mmap_page *mp;
+  struct job *j = currjob;
+  struct samples s;
+  size_t len = (RINGPAGES + 1) * MEMPAGE;
+  uint64_t lost = 0;
+  double t0;
+  int fd;
+
+  if (!new_samples(&s, arg))
+    return;
+
+  attr.type = PERF_TYPE_SOFTWARE;
+  attr.config = PERF_COUNT_SW_CPU_CLOCK;
+  attr.sample_period = 1e9 / s.hz;	/* cpu-clock counts ns */
+  attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_CALLCHAIN;
+  attr.exclude_kernel = 1;
+  attr.exclude_callchain_kernel = 1;
+  attr.disabled = 1;
+  if ((fd = perf_open(&attr, j->proc.pid, -1)) == -1)
+    {
+      errout("perf_event_open");
+      free_samples(&s);
+      return;
+    }
+  if ((mp = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+      errout("perf mmap");
+      close(fd);
+      free_samples(&s);
+      return;
+    }
+
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  t0 = now();
+  while (now() - t0 < s.secs && s.n < s.max && !interrupted())
+    {
+      lost += drain(mp, &s);
+      check_jobs();
+      if (j->state != 'r')
+	break;
+    }
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  lost += drain(mp, &s);
+
+  report_samples(j, &s, now() - t0);
+  if (lost)
+    fprintf(stderr, "%lu samples lost\r\n", lost);
+  munmap(mp, len);
+  close(fd);
+  free_samples(&s);
+}
+
+/* The counters :counters keeps, in two groups each read with one
+   read(): hardware events led by cycles, then software ones led by
+   task-clock.  Hardware events count the job's own code only.
+   Software ones are counted in the kernel too; context switches and
+   migrations happen nowhere else, so when perf_event_paranoid keeps
+   DDT out of the kernel they are left out rather than typed as 0. */
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+  const char *name;
+  int kernel;			/* only ever counted in the kernel */
+} events[] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles", 0 },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions", 0 },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache-misses", 0 },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch-misses", 0 },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, "task-clock ns", 0 },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context-switches", 1 },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page-faults", 0 },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, "cpu-migrations", 1 },
+};
+
+#define NEVENTS (sizeof(events) / sizeof(events[0]))
+#define NGROUPS 2
+
+struct counters {
+  int fd[NEVENTS];		/* -1 if the kernel would not count it */
+  int leader[NGROUPS];
+  int member[NGROUPS][NEVENTS];	/* events of each group, in read order */
+  int nmember[NGROUPS];
+  uint64_t atstop[NEVENTS];	/* at the last stop */
+  uint64_t prev[NEVENTS];	/* at the stop before */
+};
+
+void release_counters(struct job *j)
+{
+  struct counters *c = j->proc.counters;
+
+  if (!c)
+    return;
+  for (int i = 0; i < NEVENTS; i++)
+    if (c->fd[i] != -1)
+      close(c->fd[i]);
+  free(c);
+  j->proc.counters = NULL;
+}
+
+static struct counters *open_counters(struct job *j)
+{
+  struct counters *c;
+
+  if (!(c = calloc(1, sizeof(struct counters))))
+    return NULL;
+  for (int g = 0; g < NGROUPS; g++)
+    c->leader[g] = -1;
+  for (int i = 0; i < NEVENTS; i++)
+    {
+      struct perf_event_attr attr = { 0 };
+      int g = events[i].type != PERF_TYPE_HARDWARE;
+
+      attr.type = events[i].type;
+      attr.config = events[i].config;
+      attr.read_format = PERF_FORMAT_GROUP
+	| PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      attr.exclude_kernel = g == 0;
+      c->fd[i] = -1;
+      /* Without a leader the rest of its group is not tried. */
+      if (c->nmember[g] == 0 && i > 0 && events[i - 1].type == events[i].type)
+	continue;
+      if ((c->fd[i] = perf_open(&attr, j->proc.pid, c->leader[g])) == -1
+	  && errno == EACCES && !attr.exclude_kernel && !events[i].kernel)
+	{
+	  attr.exclude_kernel = 1;
+	  c->fd[i] = perf_open(&attr, j->proc.pid, c->leader[g]);
+	}
+      if (c->fd[i] == -1)
+	continue;
+      if (c->leader[g] == -1)
+	c->leader[g] = c->fd[i];
+      c->member[g][c->nmember[g]++] = i;
+    }
+  if (c->leader[0] == -1 && c->leader[1] == -1)
+    {
+      free(c);
+      return NULL;
+    }
+  return c;
+}
+
+/* Reads every counter of c into v, scaled up if the kernel had to
+   share the PMU with other events. */
+static int read_counters(struct counters *c, uint64_t *v)
+{
+  uint64_t buf[3 + NEVENTS];
+
+  for (int g = 0; g < NGROUPS; g++)
+    {
+      if (c->leader[g] == -1)
+	continue;
+      if (read(c->leader[g], buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+	return 0;
+      for (int k = 0; k < c->nmember[g] && k < buf[0]; k++)
+	{
+	  double x = buf[3 + k];
+	  if (buf[2] && buf[2] < buf[1])
+	    x = x * buf[1] / buf[2];
+	  v[c->member[g][k]] = x;
+	}
+    }
+  return 1;
+}
+
+/* Called whenever a job stops. */
+void counters_stop(struct job *j)
+{
+  struct counters *c = j->proc.counters;
+
+  if (!c)
+    return;
+  memcpy(c->prev, c->atstop, sizeof(c->prev));
+  read_counters(c, c->atstop);
+}
+
+/* :counters starts counting for the current job, or types the counts
+   and how much they went up between its last two stops.
+   :counters reset zeroes them, :counters stop closes them. */
+void counters(char *arg)
+{
+  struct job *j = currjob;
+  struct counters *c;
+  uint64_t v[NEVENTS] = { 0 };
+
+  if (!j || !j->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  if (arg && !strcmp(arg, "stop"))
+    {
+      release_counters(j);
+      return;
+    }
+  if (!(c = j->proc.counters))
+    {
+      if (!(j->proc.counters = open_counters(j)))
+	errout("perf_event_open");
+      else if (j->proc.counters->leader[0] == -1)
+	fputs("\r\nno hardware counters, counting software events\r\n", stderr);
+      return;
+    }
+  if (arg && !strcmp(arg, "reset"))
+    {
+      for (int g = 0; g < NGROUPS; g++)
+	if (c->leader[g] != -1)
+	  ioctl(c->leader[g], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      memset(c->atstop, 0, sizeof(c->atstop));
+      memset(c->prev, 0, sizeof(c->prev));
+      return;
+    }
+  if (arg && *arg)
+    {
+      fputs(" counters? ", stderr);
+      return;
+    }
+  if (!read_counters(c, v))
+    {
+      errout("counters");
+      return;
+    }
+  fprintf(stderr, "\r\n%-18s %18s %18s\r\n", "", "count", "last run");
+  for (int i = 0; i < NEVENTS; i++)
+    if (c->fd[i] != -1)
+      fprintf(stderr, "%-18s %18lu %18lu\r\n", events[i].name, v[i],
+	      c->atstop[i] - c->prev[i]);
+}
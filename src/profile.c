@@ -0,0 +1,329 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include "jobs.h"
+#include "term.h"
+#include "debugger.h"
+#include "profile.h"
+
+/* :profile samples a running job: at each tick it is stopped with
+   PTRACE_INTERRUPT, its registers are read and it is sent on with
+   PTRACE_CONT.  A sample is its pc and, when a folded stack file is
+   wanted, the return addresses found by following the frame pointer,
+   stored in a slot of an array allocated before sampling starts.
+   :sample, in perf.c, fills the same array without stopping the job. */
+
+#define PROF_TOP 40		/* lines of the flat profile */
+
+struct profline {
+  long count;
+  const char *name;
+};
+
+/* ^D stops sampling. */
+static int interrupted(void)
+{
+  struct pollfd p = { 0, POLLIN, 0 };
+
+  if (poll(&p, 1, 0) == 1 && (p.revents & POLLIN))
+    return term_read() == ('D' - 64);
+  return 0;
+}
+
+static int linecmp(const void *a, const void *b)
+{
+  const struct profline *x = a, *y = b;
+  return y->count < x->count ? -1 : y->count > x->count;
+}
+
+static int ptrcmp(const void *a, const void *b)
+{
+  uintptr_t x = *(const uintptr_t *)a, y = *(const uintptr_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static int strpcmp(const void *a, const void *b)
+{
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* The symbol containing pc, or failing that the file mapped there. */
+static const char *pcname(struct job *j, struct regions *rs, uint64_t pc)
+{
+  const char *name;
+  struct region *r;
+  uint64_t off;
+
+  if ((name = job_symbol(j, pc, &off)))
+    return name;
+  if (rs && (r = find_region(rs, pc)) && r->name)
+    {
+      const char *s = strrchr(r->name, '/');
+      return s ? s + 1 : r->name;
+    }
+  return "?";
+}
+
+/* Takes one sample of the stopped job j into pcs, returning how
+   many frames it has. */
+static int sample(struct job *j, uint64_t *pcs, int depth)
+{
+  struct user_regs_struct regs;
+  uint64_t frame[2], fp;
+  int n = 1;
+
+  if (ptrace(PTRACE_GETREGS, j->proc.pid, NULL, &regs) == -1)
+    return 0;
+  pcs[0] = regs.rip;
+  for (fp = regs.rbp; n < depth; n++)
+    {
+      struct iovec local = { frame, sizeof(frame) };
+      struct iovec remote = { (void *)fp, sizeof(frame) };
+      if (process_vm_readv(j->proc.pid, &local, 1, &remote, 1, 0) != sizeof(frame)
+	  || !frame[1])
+	break;
+      pcs[n] = frame[1] - 1;	/* in the call, not after it */
+      if (frame[0] <= fp)
+	{
+	  n++;
+	  break;
+	}
+      fp = frame[0];
+    }
+  return n;
+}
+
+/* Types the flat profile of the samples s, taken over secs seconds,
+   and writes their folded stacks if a file was given. */
+void report_samples(struct job *j, struct samples *s, double secs)
+{
+  uint64_t *pcs = s->pcs;
+  uint8_t *depth = s->depth;
+  long n = s->n;
+  int stride = s->stride;
+  char *file = s->file;
+  struct profline *lines;
+  const char **names;
+  struct regions *rs;
+  uint64_t off;
+  long nlines = 0;
+
+  fprintf(stderr, "\r\n%ld samples in %.2f s (%.0f Hz)\r\n",
+	  n, secs, secs > 0 ? n / secs : 0.0);
+  if (!n)
+    return;
+  /* The region index of a running job is read again at each call, so
+     it is fetched once, after job_symbol() has used it to find where
+     the executable is. */
+  job_symbol(j, pcs[0], &off);
+  rs = job_regions(j);
+  names = malloc(n * sizeof(char *));
+  lines = calloc(n, sizeof(struct profline));
+  if (!names || !lines)
+    {
+      errout("profile");
+      free(names);
+      free(lines);
+      return;
+    }
+
+  /* Names point into a symbol index or the region index, so equal
+     names are equal pointers and sorting those groups them. */
+  for (long i = 0; i < n; i++)
+    names[i] = pcname(j, rs, pcs[i * stride]);
+  qsort(names, n, sizeof(char *), ptrcmp);
+  for (long i = 0; i < n; i++)
+    {
+      if (!i || names[i] != names[i - 1])
+	lines[nlines++].name = names[i];
+      lines[nlines - 1].count++;
+    }
+  free(names);
+  qsort(lines, nlines, sizeof(struct profline), linecmp);
+  for (int k = 0; k < nlines && k < PROF_TOP; k++)
+    fprintf(stderr, "%8ld %5.1f%%  %s\r\n", lines[k].count,
+	    100.0 * lines[k].count / n, lines[k].name);
+  free(lines);
+
+  if (file)
+    {
+      FILE *f;
+      char **stacks;
+
+      if (!(f = fopen(file, "w")) || !(stacks = calloc(n, sizeof(char *))))
+	{
+	  errout(file);
+	  if (f)
+	    fclose(f);
+	  return;
+	}
+      for (long i = 0; i < n; i++)
+	{
+	  size_t len;
+	  FILE *m = open_memstream(&stacks[i], &len);
+	  for (int d = depth[i]; d--;)
+	    fprintf(m, "%s%s", pcname(j, rs, pcs[i * stride + d]), d ? ";" : "");
+	  fclose(m);
+	}
+      qsort(stacks, n, sizeof(char *), strpcmp);
+      for (long i = 0, k; i < n; i = k)
+	{
+	  for (k = i + 1; k < n && !strcmp(stacks[i], stacks[k]); k++)
+	    ;
+	  fprintf(f, "%s %ld\n", stacks[i], k - i);
+	}
+      for (long i = 0; i < n; i++)
+	free(stacks[i]);
+      free(stacks);
+      if (fclose(f) == EOF)
+	errout(file);
+      else
+	fprintf(stderr, "folded stacks in %s\r\n", file);
+    }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void free_samples(struct samples *s)
+{
+  free(s->pcs);
+  free(s->depth);
+  s->pcs = NULL;
+  s->depth = NULL;
+}
+
+/* Parses [<seconds> [<hz> [<file>]]] for the current job, which must
+   be running, and allocates room for the samples.  Complains and
+   returns 0 if it cannot. */
+int new_samples(struct samples *s, char *arg)
+{
+  char *end;
+
+  if (!currjob || !currjob->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return 0;
+    }
+  if (currjob->state != 'r')
+    {
+      fputs(" job not running? ", stderr);
+      return 0;
+    }
+  memset(s, 0, sizeof(struct samples));
+  s->secs = 5;
+  s->hz = 100;
+  if (arg && *arg)
+    {
+      s->secs = strtod(arg, &end);
+      if (*end == ' ')
+	s->hz = strtod(end, &end);
+      while (*end == ' ')
+	end++;
+      if (*end)
+	s->file = end;
+    }
+  if (s->secs <= 0 || s->hz <= 0 || s->hz > 100000
+      || (s->max = s->secs * s->hz) > PROF_MAX)
+    {
+      fputs(" too many samples? ", stderr);
+      return 0;
+    }
+  if (s->max < 1)
+    s->max = 1;
+  s->stride = s->file ? PROF_DEPTH : 1;
+  s->pcs = malloc(s->max * s->stride * sizeof(uint64_t));
+  s->depth = malloc(s->max);
+  if (!s->pcs || !s->depth)
+    {
+      errout("profile");
+      free_samples(s);
+      return 0;
+    }
+  return 1;
+}
+
+/* :profile [<seconds> [<hz> [<file>]]] */
+void profile(char *arg)
+{
+  struct job *j = currjob;
+  struct samples s;
+  struct timespec next;
+  double t0;
+  int status;
+
+  if (!new_samples(&s, arg))
+    return;
+
+  long period = 1e9 / s.hz;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  t0 = now();
+  while (s.n < s.max && j->state == 'r' && !interrupted())
+    {
+      next.tv_nsec += period;
+      next.tv_sec += next.tv_nsec / 1000000000;
+      next.tv_nsec %= 1000000000;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+	;
+
+      if (ptrace(PTRACE_INTERRUPT, j->proc.pid, NULL, NULL) == -1)
+	break;
+      /* Anything else the job does on the way to the interrupt stop
+	 is handled as usual; if that leaves it stopped, sampling is
+	 over. */
+      for (;;)
+	{
+	  if (waitpid(j->proc.pid, &status, 0) == -1)
+	    {
+	      if (errno == EINTR)
+		continue;
+	      goto done;
+	    }
+	  if (WIFSTOPPED(status) && status >> 16 == PTRACE_EVENT_STOP)
+	    break;
+	  job_changed(j, status);
+	  if (j->state != 'r')
+	    goto done;
+	}
+      if ((s.depth[s.n] = sample(j, s.pcs + s.n * s.stride, s.stride)))
+	s.n++;
+      if (ptrace(PTRACE_CONT, j->proc.pid, NULL, NULL) == -1)
+	break;
+    }
+ done:
+  report_samples(j, &s, now() - t0);
+  free_samples(&s);
+}
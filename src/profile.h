@@ -0,0 +1,38 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define PROF_MAX (1 << 20)	/* samples */
+#define PROF_DEPTH 16		/* frames of a folded stack */
+
+/* Samples of a job's pc, each followed by depth - 1 return addresses
+   when stride is PROF_DEPTH. */
+struct samples {
+  uint64_t *pcs;		/* max slots of stride words */
+  uint8_t *depth;		/* frames in each slot */
+  long n;
+  long max;
+  int stride;
+  double secs;
+  double hz;
+  char *file;			/* for folded stacks, or NULL */
+};
+
+int new_samples(struct samples *s, char *arg);
+void report_samples(struct job *j, struct samples *s, double secs);
+void free_samples(struct samples *s);
+void profile(char *);
@@ -0,0 +1,226 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include "jobs.h"
+#include "debugger.h"
+#include "aeval.h"
+#include "raid.h"
+
+/* Raid registers.  Each job has NRAID of them, numbered from 1, each
+   watching one word in the typeout mode that was current when it was
+   set.  When the job stops they are all read with one
+   process_vm_readv and the ones that changed are typed. */
+
+struct raidreg {
+  uint64_t addr;
+  typeoutfunc *tm;
+  uint64_t last;		/* as last typed */
+  int set;
+  int shown;			/* last is valid */
+};
+
+struct raids {
+  struct raidreg r[NRAID];
+};
+
+static int raidoff;		/* ..RAID, $0V */
+
+void release_raid(struct job *j)
+{
+  free(j->proc.raid);
+  j->proc.raid = NULL;
+}
+
+static struct raids *raids(struct job *j)
+{
+  if (!j->proc.raid && !(j->proc.raid = calloc(1, sizeof(struct raids))))
+    errout("raid");
+  return j->proc.raid;
+}
+
+/* Reads every set register, typing those that changed since they
+   were last typed, or all if all, a line each.  lead goes before the
+   first. */
+void show_raids(struct job *j, int all, const char *lead)
+{
+  struct raids *rs = j->proc.raid;
+  struct iovec local[NRAID], remote[NRAID];
+  uint64_t val[NRAID];
+  int which[NRAID], n = 0;
+  ssize_t got;
+
+  if (!rs)
+    return;
+  for (int i = 0; i < NRAID; i++)
+    if (rs->r[i].set)
+      {
+	which[n] = i;
+	local[n].iov_base = &val[n];
+	local[n].iov_len = sizeof(val[n]);
+	remote[n].iov_base = (void *)rs->r[i].addr;
+	remote[n].iov_len = sizeof(val[n]);
+	n++;
+      }
+  if (!n)
+    return;
+  if (j->state != 'r' && !flush_mem(j))
+    errout("deposit");
+
+  /* The read stops short at a register whose word cannot be read;
+     go on from the one after it. */
+  for (int k = 0; k < n; k += got / sizeof(uint64_t) + 1)
+    {
+      got = process_vm_readv(j->proc.pid, local + k, n - k, remote + k, n - k, 0);
+      if (got < 0)
+	got = 0;
+      for (int m = k; m < k + got / sizeof(uint64_t); m++)
+	{
+	  struct raidreg *r = &rs->r[which[m]];
+	  if (!all && r->shown && r->last == val[m])
+	    continue;
+	  fprintf(stderr, "%s%lx/   ", lead, r->addr);
+	  r->tm(val[m]);
+	  fputs("\r\n", stderr);
+	  lead = "";
+	  r->last = val[m];
+	  r->shown = 1;
+	}
+      int bad = k + got / sizeof(uint64_t);
+      if (bad < n && (all || rs->r[which[bad]].shown))
+	{
+	  fprintf(stderr, "%s%lx/   ?\r\n", lead, rs->r[which[bad]].addr);
+	  lead = "";
+	  rs->r[which[bad]].shown = 0;
+	}
+    }
+}
+
+/* Called whenever a job stops. */
+void raid_stop(struct job *j, const char *lead)
+{
+  if (!raidoff)
+    show_raids(j, 0, lead);
+}
+
+static int set_raid(struct job *j, int n, uint64_t addr)
+{
+  struct raids *rs;
+
+  if (!(rs = raids(j)))
+    return 0;
+  if (n < 0)
+    {
+      for (int i = 0; i < NRAID; i++)
+	if (rs->r[i].set && rs->r[i].addr == addr)
+	  rs->r[i].set = 0;
+      for (n = 0; n < NRAID && rs->r[n].set; n++)
+	;
+      if (n == NRAID)
+	{
+	  errno = ENOSPC;
+	  return 0;
+	}
+    }
+  rs->r[n].addr = addr;
+  rs->r[n].tm = sch;
+  rs->r[n].set = 1;
+  rs->r[n].shown = 0;
+  return 1;
+}
+
+/* $V and its variants; arg4 is the
+   number between them and the V, if any. */
+void raid_cmd(struct job *j, const char *prefix, const char *arg4)
+{
+  struct raids *rs = j->proc.raid;
+  int n = *arg4 ? atoi(arg4) : -1;
+  uint64_t addr;
+  char *r;
+
+  if (n > NRAID)
+    {
+      fputs("?? ", stderr);
+      return;
+    }
+  if (!*prefix)
+    {
+      if (n == 0)
+	raidoff = !raidoff;
+      else if (n > 0)
+	{
+	  if (!rs || !rs->r[n - 1].set)
+	    fputs(" no raid register? ", stderr);
+	  else
+	    rs->r[n - 1].tm = sch;
+	}
+      else
+	{
+	  show_raids(j, 1, "\r\n");
+	  return;
+	}
+      fputs("   ", stderr);
+      return;
+    }
+  if (!(r = evalexpr((char *)prefix, &addr)) || *r)
+    {
+      fputs("?? ", stderr);
+      return;
+    }
+  if (n == 0)
+    {
+      for (int i = 0; rs && i < NRAID; i++)
+	if (rs->r[i].set && rs->r[i].addr == addr)
+	  {
+	    rs->r[i].set = 0;
+	    break;
+	  }
+    }
+  else if (n > 0 && addr == (uint64_t)-1)
+    {
+      if (rs)
+	rs->r[n - 1].set = 0;
+    }
+  else if (!set_raid(j, n > 0 ? n - 1 : -1, addr))
+    {
+      errout("raid");
+      return;
+    }
+  else
+    {
+      show_raids(j, 0, "\r\n");
+      return;
+    }
+  fputs("   ", stderr);
+}
+
+void raidflush(char *unused)
+{
+  if (!currjob)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  release_raid(currjob);
+}
@@ -0,0 +1,249 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/reg.h>
+#include "jobs.h"
+#include "debugger.h"
+#include "tracefile.h"
+#include "record.h"
+
+/* :record <file> writes what happens to the current job, the
+   instructions ^N steps, breakpoint hits, signals and system calls,
+   to a trace file in the format of tracefile.h.  The file is written
+   through a window mapped over its end, which moves on when full, so
+   an event costs a few stores and no system call. */
+
+#define WINDOW (16 << 20)
+
+static struct job *recjob;
+static int recfd = -1;
+static char *recname;
+static uint8_t *map;		/* WINDOW bytes of the file... */
+static uint64_t mapoff;		/* ...from here */
+static size_t pos;		/* next byte in map */
+static uint64_t lasttime, lastpc, nevents;
+
+static uint64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int window(uint64_t off)
+{
+  if (map)
+    munmap(map, WINDOW);
+  map = NULL;
+  if (ftruncate(recfd, off + WINDOW) == -1)
+    return 0;
+  if ((map = mmap(NULL, WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED,
+		  recfd, off)) == MAP_FAILED)
+    {
+      map = NULL;
+      return 0;
+    }
+  mapoff = off;
+  return 1;
+}
+
+static void finish(void)
+{
+  uint64_t len = mapoff + pos;
+
+  if (map)
+    munmap(map, WINDOW);
+  map = NULL;
+  if (ftruncate(recfd, len) == -1)
+    errout(recname);
+  close(recfd);
+  fprintf(stderr, "\r\n%lu events, %lu bytes in %s\r\n", nevents, len, recname);
+  free(recname);
+  recname = NULL;
+  recfd = -1;
+  recjob = NULL;
+}
+
+static uint8_t *put(uint8_t *p, uint64_t v)
+{
+  while (v >= 0x80)
+    {
+      *p++ = v | 0x80;
+      v >>= 7;
+    }
+  *p++ = v;
+  return p;
+}
+
+static uint8_t *putpc(uint8_t *p, uint64_t pc)
+{
+  p = put(p, zigzag(pc - lastpc));
+  lastpc = pc;
+  return p;
+}
+
+/* Start an event of type for j, or return NULL if j is not being
+   recorded. */
+static uint8_t *begin(struct job *j, int type)
+{
+  uint64_t t;
+
+  if (!j || j != recjob)
+    return NULL;
+  if (pos + EV_MAXLEN > WINDOW)
+    {
+      size_t keep = pos % MEMPAGE;
+      if (!window(mapoff + pos - keep))
+	{
+	  errout(recname);
+	  finish();
+	  return NULL;
+	}
+      pos = keep;
+    }
+  t = now();
+  map[pos] = type;
+  uint8_t *p = put(map + pos + 1, t - lasttime);
+  lasttime = t;
+  return p;
+}
+
+static void end(uint8_t *p)
+{
+  pos = p - map;
+  nevents++;
+}
+
+void record_step(struct job *j, uint64_t pc)
+{
+  uint8_t *p;
+
+  if ((p = begin(j, EV_STEP)))
+    end(putpc(p, pc));
+}
+
+void record_bpt(struct job *j, uint64_t pc, int n)
+{
+  uint8_t *p;
+
+  if ((p = begin(j, EV_BPT)))
+    end(put(putpc(p, pc), n));
+}
+
+void record_signal(struct job *j, int sig)
+{
+  uint8_t *p;
+
+  if (!(p = begin(j, EV_SIGNAL)))
+    return;
+  struct user_regs_struct *regs = job_regs(j);
+  end(put(putpc(p, regs ? regs->rip : 0), sig));
+}
+
+void record_syscall(struct job *j, uint64_t pc, int nr, const uint64_t *args)
+{
+  uint8_t *p;
+
+  if (!(p = begin(j, EV_SYSCALL)))
+    return;
+  p = put(putpc(p, pc), nr);
+  for (int i = 0; i < 6; i++)
+    p = put(p, args[i]);
+  end(p);
+}
+
+void record_sysret(struct job *j, int nr, int64_t ret)
+{
+  uint8_t *p;
+
+  if ((p = begin(j, EV_SYSRET)))
+    end(put(put(p, nr), zigzag(ret)));
+}
+
+/* The job is gone; the recording ends with it. */
+void record_exit(struct job *j, int status)
+{
+  uint8_t *p;
+
+  if (!(p = begin(j, EV_EXIT)))
+    return;
+  end(put(p, (uint32_t)status));
+  finish();
+}
+
+/* :record <file> starts recording the current job, :record alone
+   stops. */
+void record(char *file)
+{
+  struct job *j = currjob;
+  struct tracehdr hdr = { TRACE_MAGIC, TRACE_VERSION };
+  struct timespec ts;
+
+  if (!file || !*file)
+    {
+      if (recjob)
+	finish();
+      else
+	fputs(" not recording? ", stderr);
+      return;
+    }
+  if (!j || !j->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  if (recjob)
+    finish();
+
+  if ((recfd = openat(msname.fd, file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) == -1)
+    {
+      errout(file);
+      return;
+    }
+  if (!window(0) || !(recname = strdup(file)))
+    {
+      errout(file);
+      if (map)
+	munmap(map, WINDOW);
+      map = NULL;
+      close(recfd);
+      recfd = -1;
+      return;
+    }
+  clock_gettime(CLOCK_REALTIME, &ts);
+  hdr.pid = j->proc.pid;
+  hdr.start = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  memcpy(map, &hdr, sizeof(hdr));
+  pos = sizeof(hdr);
+  lasttime = now();
+  lastpc = 0;
+  nevents = 0;
+  recjob = j;
+  fprintf(stderr, "\r\nrecording to %s\r\n", file);
+}
@@ -0,0 +1,25 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+void record(char *);
+void record_step(struct job *j, uint64_t pc);
+void record_bpt(struct job *j, uint64_t pc, int n);
+void record_signal(struct job *j, int sig);
+void record_syscall(struct job *j, uint64_t pc, int nr, const uint64_t *args);
+void record_sysret(struct job *j, int nr, int64_t ret);
+void record_exit(struct job *j, int status);
@@ -0,0 +1,241 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+#include "jobs.h"
+#include "term.h"
+#include "debugger.h"
+#include "search.h"
+
+#define CHUNK (1 << 20)
+#define CHUNKWORDS (CHUNK / sizeof(uint64_t))
+
+uint64_t masks[NMASKS] = {
+  -1, 0xffffffff, 0xffffffff00000000, -1, -1, -1, -1, -1
+};
+
+static uint64_t *chunk;
+static uint32_t *hits;
+
+/* Each scanner stores the indices of the words w[i] for which
+   (w[i] & mask) == word, or != word if ne, and returns how many.
+   word is already masked. */
+
+#ifndef __x86_64__
+static size_t scan_scalar(const uint64_t *w, size_t n, uint64_t word,
+			  uint64_t mask, int ne, uint32_t *hit)
+{
+  size_t k = 0;
+
+  for (size_t i = 0; i < n; i++)
+    if (((w[i] & mask) == word) != ne)
+      hit[k++] = i;
+  return k;
+}
+#else
+static size_t scan_sse2(const uint64_t *w, size_t n, uint64_t word,
+			uint64_t mask, int ne, uint32_t *hit)
+{
+  const __m128i m = _mm_set1_epi64x(mask);
+  const __m128i v = _mm_set1_epi64x(word);
+  const unsigned flip = ne ? 0xff : 0;
+  size_t i, k = 0;
+
+  /* No 64 bit compare before SSE4.1: compare 32 bit halves and
+     require both to match. */
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      unsigned bits = 0;
+      for (int q = 0; q < 4; q++)
+	{
+	  __m128i x = _mm_loadu_si128((const __m128i *)(w + i + 2 * q));
+	  __m128i e = _mm_cmpeq_epi32(_mm_and_si128(x, m), v);
+	  e = _mm_and_si128(e, _mm_shuffle_epi32(e, _MM_SHUFFLE(2, 3, 0, 1)));
+	  bits |= _mm_movemask_pd(_mm_castsi128_pd(e)) << (2 * q);
+	}
+      for (bits ^= flip; bits; bits &= bits - 1)
+	hit[k++] = i + __builtin_ctz(bits);
+    }
+  for (; i < n; i++)
+    if (((w[i] & mask) == word) != ne)
+      hit[k++] = i;
+  return k;
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const uint64_t *w, size_t n, uint64_t word,
+			uint64_t mask, int ne, uint32_t *hit)
+{
+  const __m256i m = _mm256_set1_epi64x(mask);
+  const __m256i v = _mm256_set1_epi64x(word);
+  const unsigned flip = ne ? 0xffff : 0;
+  size_t i, k = 0;
+
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      unsigned bits = 0;
+      for (int q = 0; q < 4; q++)
+	{
+	  __m256i x = _mm256_loadu_si256((const __m256i *)(w + i + 4 * q));
+	  __m256i e = _mm256_cmpeq_epi64(_mm256_and_si256(x, m), v);
+	  bits |= _mm256_movemask_pd(_mm256_castsi256_pd(e)) << (4 * q);
+	}
+      for (bits ^= flip; bits; bits &= bits - 1)
+	hit[k++] = i + __builtin_ctz(bits);
+    }
+  for (; i < n; i++)
+    if (((w[i] & mask) == word) != ne)
+      hit[k++] = i;
+  return k;
+}
+#endif
+
+typedef size_t (scanfunc)(const uint64_t *, size_t, uint64_t, uint64_t, int, uint32_t *);
+
+static scanfunc *pick_scanner(void)
+{
+#ifdef __x86_64__
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return scan_avx2;
+  return scan_sse2;
+#else
+  return scan_scalar;
+#endif
+}
+
+/* ^D stops a search in progress. */
+static int interrupted(void)
+{
+  struct pollfd p = { 0, POLLIN, 0 };
+
+  if (poll(&p, 1, 0) == 1 && (p.revents & POLLIN))
+    return term_read() == ('D' - 64);
+  return 0;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void search(struct job *j, int how, uint64_t word, uint64_t mask,
+	    uint64_t lo, uint64_t hi)
+{
+  static scanfunc *scan;
+  pid_t pid = (j && j->proc.pid) ? j->proc.pid : getpid();
+  struct regions *rs;
+  size_t nhits = 0;
+  uint64_t bytes = 0;
+  int stop = 0;
+
+  if (!scan)
+    scan = pick_scanner();
+  if (!chunk
+      && (!(chunk = malloc(CHUNK)) || !(hits = malloc(CHUNKWORDS * sizeof(uint32_t)))))
+    {
+      free(chunk);
+      chunk = NULL;
+      errout("search");
+      return;
+    }
+
+  if (how == SEARCH_EA)
+    mask = EAMASK;
+  word &= mask;
+
+  if (j && j->proc.pid && !flush_mem(j))
+    errout("deposit");
+
+  if (!j || !j->proc.pid)
+    refresh_regions(j);
+  if (!(rs = job_regions(j)))
+    {
+      errout("maps");
+      return;
+    }
+
+  double t0 = now();
+
+  for (int r = 0; !stop && r < rs->n; r++)
+    {
+      uint64_t start = rs->r[r].start;
+      uint64_t end = rs->r[r].end;
+
+      if (!(rs->r[r].prot & PROT_READ) || end <= lo || start >= hi)
+	continue;
+      if (start < lo)
+	start = lo;
+      if (end > hi)
+	end = hi;
+      start = (start + 7) & ~(uint64_t)7;
+
+      while (!stop && start + sizeof(uint64_t) <= end)
+	{
+	  size_t len = end - start < CHUNK ? end - start : CHUNK;
+	  struct iovec local = { chunk, len & ~(size_t)7 };
+	  struct iovec remote = { (void *)start, len & ~(size_t)7 };
+	  ssize_t n;
+
+	  errno = 0;
+	  if ((n = process_vm_readv(pid, &local, 1, &remote, 1, 0)) <= 0)
+	    {
+	      /* Unreadable page in the way; skip past it. */
+	      start = (start | (MEMPAGE - 1)) + 1;
+	      continue;
+	    }
+
+	  size_t nw = n / sizeof(uint64_t);
+	  size_t k = scan(chunk, nw, word, mask, how == SEARCH_NE, hits);
+	  for (size_t i = 0; i < k && !stop; i++)
+	    {
+	      uint64_t a = start + (uint64_t)hits[i] * sizeof(uint64_t);
+	      fprintf(stderr, "\r\n%lx/   ", a);
+	      if (openlocation(j, a))
+		sch(qreg);
+	      stop = interrupted();
+	    }
+	  nhits += k;
+	  bytes += nw * sizeof(uint64_t);
+	  start += nw * sizeof(uint64_t);
+	  if (!stop)
+	    stop = interrupted();
+	}
+    }
+
+  double dt = now() - t0;
+  fprintf(stderr, "\r\n%ld found, %.1f MB in %.3f s (%.0f MB/s)%s\r\n",
+	  nhits, bytes / 1048576.0, dt,
+	  dt > 0 ? bytes / 1048576.0 / dt : 0.0,
+	  stop ? " interrupted" : "");
+}
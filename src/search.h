@@ -0,0 +1,29 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define SEARCH_EQ 0		/* $W */
+#define SEARCH_NE 1		/* $N */
+#define SEARCH_EA 2		/* $E */
+
+#define NMASKS 8
+#define EAMASK 0x0000ffffffffffffULL
+
+void search(struct job *j, int how, uint64_t word, uint64_t mask,
+	    uint64_t lo, uint64_t hi);
+
+extern uint64_t masks[NMASKS];
@@ -0,0 +1,299 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include "jobs.h"
+#include "debugger.h"
+#include "snap.h"
+
+/* Memory snapshots.  :snap arms a snapshot that is taken the next
+   time the job is resumed: the writable private mappings are copied
+   and the soft-dirty bits cleared through /proc/pid/clear_refs.  At a
+   later stop :sdiff reads /proc/pid/pagemap and compares only the
+   pages the job has written since.  Kernels without soft-dirty
+   tracking never set the bit; then every page is compared. */
+
+#define PM_SOFT_DIRTY (1ULL << 55)
+#define BATCHPAGES 256
+
+struct snapreg {
+  uint64_t start;
+  uint64_t end;
+  char *data;
+};
+
+struct snapshot {
+  int armed;
+  int taken;
+  int softdirty;		/* kernel keeps soft-dirty bits */
+  int n;
+  struct snapreg *r;
+};
+
+static void free_regions(struct snapshot *s)
+{
+  for (int i = 0; i < s->n; i++)
+    free(s->r[i].data);
+  free(s->r);
+  s->r = NULL;
+  s->n = 0;
+  s->taken = 0;
+}
+
+void release_snap(struct job *j)
+{
+  if (j->proc.snap)
+    {
+      free_regions(j->proc.snap);
+      free(j->proc.snap);
+      j->proc.snap = NULL;
+    }
+}
+
+static int procfd(pid_t pid, const char *what, int flags)
+{
+  char path[64];
+
+  snprintf(path, sizeof(path), "/proc/%d/%s", pid, what);
+  return open(path, flags | O_CLOEXEC);
+}
+
+/* Nonzero if any page of the snapshot has its soft-dirty bit set,
+   which a kernel with the feature does for every page written since
+   the job started. */
+static int softdirty_seen(pid_t pid, struct snapshot *s)
+{
+  uint64_t ents[BATCHPAGES];
+  int fd, seen = 0;
+
+  if ((fd = procfd(pid, "pagemap", O_RDONLY)) == -1)
+    return 0;
+  for (int i = 0; i < s->n && !seen; i++)
+    for (uint64_t a = s->r[i].start; a < s->r[i].end && !seen; a += BATCHPAGES * MEMPAGE)
+      {
+	uint64_t npages = (s->r[i].end - a) / MEMPAGE;
+	if (npages > BATCHPAGES)
+	  npages = BATCHPAGES;
+	ssize_t n = pread(fd, ents, npages * 8, (a / MEMPAGE) * 8);
+	for (int k = 0; k < n / 8; k++)
+	  if (ents[k] & PM_SOFT_DIRTY)
+	    seen = 1;
+      }
+  close(fd);
+  return seen;
+}
+
+/* Called from sync_mem() just before the job is resumed. */
+void take_snap(struct job *j)
+{
+  struct snapshot *s = j->proc.snap;
+  struct regions *rs;
+  int fd;
+
+  if (!s || !s->armed)
+    return;
+  s->armed = 0;
+  free_regions(s);
+
+  if (!(rs = job_regions(j)))
+    {
+      errout("snap maps");
+      return;
+    }
+  if ((s->r = calloc(rs->n, sizeof(struct snapreg))) == NULL)
+    {
+      errout("snap");
+      return;
+    }
+
+  for (int i = 0; i < rs->n; i++)
+    {
+      struct region *r = &rs->r[i];
+      if ((r->prot & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE)
+	  || (r->prot & REGION_SHARED))
+	continue;
+
+      struct snapreg *sr = &s->r[s->n];
+      size_t len = r->end - r->start;
+      struct iovec local, remote = { (void *)r->start, len };
+      if ((sr->data = malloc(len)) == NULL)
+	{
+	  errout("snap");
+	  free_regions(s);
+	  return;
+	}
+      local.iov_base = sr->data;
+      local.iov_len = len;
+      if (process_vm_readv(j->proc.pid, &local, 1, &remote, 1, 0) != len)
+	{
+	  free(sr->data);
+	  continue;
+	}
+      sr->start = r->start;
+      sr->end = r->end;
+      s->n++;
+    }
+
+  s->softdirty = softdirty_seen(j->proc.pid, s);
+  if (s->softdirty)
+    {
+      if ((fd = procfd(j->proc.pid, "clear_refs", O_WRONLY)) == -1
+	  || write(fd, "4", 1) != 1)
+	{
+	  errout("clear_refs");
+	  s->softdirty = 0;
+	}
+      if (fd != -1)
+	close(fd);
+    }
+  s->taken = 1;
+}
+
+void snap(char *unused)
+{
+  struct job *j = currjob;
+
+  if (!j || !j->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  if (!j->proc.snap && (j->proc.snap = calloc(1, sizeof(struct snapshot))) == NULL)
+    {
+      errout("snap");
+      return;
+    }
+  j->proc.snap->armed = 1;
+  fputs("\r\nsnapshot taken when the job next runs\r\n", stderr);
+}
+
+static void showword(uint64_t a, uint64_t old, uint64_t new)
+{
+  fprintf(stderr, "%lx/   ", a);
+  sch(old);
+  sch(new);
+  fputs("\r\n", stderr);
+}
+
+void sdiff(char *unused)
+{
+  struct job *j = currjob;
+  struct snapshot *s;
+  uint64_t ents[BATCHPAGES];
+  char *pages;
+  int fd = -1;
+  long npages = 0, ndirty = 0, nwords = 0;
+
+  if (!j || !j->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  if (!(s = j->proc.snap) || !s->taken)
+    {
+      fputs(" no snapshot? ", stderr);
+      return;
+    }
+  if (j->state == 'r')
+    {
+      fputs(" job running? ", stderr);
+      return;
+    }
+  if (!flush_mem(j))
+    errout("deposit");
+  if (s->softdirty && (fd = procfd(j->proc.pid, "pagemap", O_RDONLY)) == -1)
+    {
+      errout("pagemap");
+      return;
+    }
+  if ((pages = malloc(BATCHPAGES * MEMPAGE)) == NULL)
+    {
+      errout("sdiff");
+      goto out;
+    }
+
+  fputs("\r\n", stderr);
+  for (int i = 0; i < s->n; i++)
+    for (uint64_t a = s->r[i].start; a < s->r[i].end; a += BATCHPAGES * MEMPAGE)
+      {
+	struct iovec local[BATCHPAGES], remote[BATCHPAGES];
+	uint64_t addr[BATCHPAGES];
+	int n = (s->r[i].end - a) / MEMPAGE;
+	int k = 0;
+
+	if (n > BATCHPAGES)
+	  n = BATCHPAGES;
+	npages += n;
+
+	/* Gather the dirty pages of this batch, then fetch them all
+	   with one call. */
+	if (s->softdirty
+	    && pread(fd, ents, n * 8, (a / MEMPAGE) * 8) != n * 8)
+	  continue;
+	for (int p = 0; p < n; p++)
+	  if (!s->softdirty || (ents[p] & PM_SOFT_DIRTY))
+	    {
+	      addr[k] = a + (uint64_t)p * MEMPAGE;
+	      local[k].iov_base = pages + k * MEMPAGE;
+	      local[k].iov_len = MEMPAGE;
+	      remote[k].iov_base = (void *)addr[k];
+	      remote[k].iov_len = MEMPAGE;
+	      k++;
+	    }
+	if (!k)
+	  continue;
+	ssize_t got = process_vm_readv(j->proc.pid, local, k, remote, k, 0);
+	if (got < 0)
+	  got = 0;
+	if (s->softdirty)
+	  ndirty += k;
+
+	for (int p = 0; p < got / MEMPAGE; p++)
+	  {
+	    const uint64_t *old = (uint64_t *)(s->r[i].data + (addr[p] - s->r[i].start));
+	    const uint64_t *new = (uint64_t *)(pages + p * MEMPAGE);
+	    if (!memcmp(old, new, MEMPAGE))
+	      continue;
+	    if (!s->softdirty)
+	      ndirty++;
+	    for (int w = 0; w < MEMPAGE / sizeof(uint64_t); w++)
+	      if (old[w] != new[w])
+		{
+		  showword(addr[p] + w * sizeof(uint64_t), old[w], new[w]);
+		  nwords++;
+		}
+	  }
+      }
+
+  fprintf(stderr, "%ld words changed in %ld of %ld pages%s\r\n",
+	  nwords, ndirty, npages, s->softdirty ? " (soft-dirty)" : "");
+
+ out:
+  free(pages);
+  if (fd != -1)
+    close(fd);
+}
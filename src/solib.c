@@ -0,0 +1,470 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <elf.h>
+#include <link.h>
+#include "jobs.h"
+#include "debugger.h"
+#include "bpt.h"
+#include "elffile.h"
+#include "symbols.h"
+#include "solib.h"
+
+/* Shared objects.  Each job keeps a list of the objects loaded in it
+   besides the executable, each with its load bias and the addresses
+   it spans: found by walking the dynamic linker's r_debug and
+   link_map in the job, or from /proc/pid/maps before the linker has
+   set those up, plus the vDSO the auxiliary vector points at.  An
+   object's symbols are indexed only the first time an address or a
+   name is looked up in it.  The linker calls _dl_debug_state around
+   every dlopen and dlclose, and a breakpoint there marks the list
+   stale; the next lookup walks link_map again, keeping the objects it
+   already knows.  Until that breakpoint can be set the list is walked
+   again whenever the job has run since. */
+
+#define MAXOBJS 4096		/* bound on a link_map walk */
+#define MAXDYN 1024		/* and on the executable's _DYNAMIC */
+#define VDSO_MAX (1 << 16)
+
+struct objfile {
+  char *path;			/* NULL for the vDSO */
+  uint64_t bias;		/* l_addr, added to addresses in the file */
+  uint64_t lo, hi;		/* the addresses it is loaded at */
+  struct symindex *idx;
+  int tried;			/* indexed, perhaps in vain */
+  int seen;			/* found by the latest walk */
+};
+
+struct solibs {
+  struct objfile *o;
+  int n;
+  int max;
+  pid_t pid;			/* the process walked */
+  unsigned runs;		/* its proc.runs when walked */
+  int stale;			/* _dl_debug_state hit since */
+  uint64_t rdebug;		/* its r_debug, once the linker has set it */
+  uint64_t brk;			/* the breakpoint, 0 if not set */
+};
+
+/* What the kernel told the job's dynamic linker. */
+struct auxv {
+  uint64_t phdr;		/* the executable's program headers */
+  uint64_t phnum;
+  uint64_t base;		/* the dynamic linker */
+  uint64_t vdso;
+};
+
+static void drop(struct objfile *o)
+{
+  free_symindex(o->idx);
+  free(o->path);
+}
+
+static int read_auxv(pid_t pid, struct auxv *a)
+{
+  char path[64];
+  Elf64_auxv_t v;
+  FILE *f;
+
+  snprintf(path, sizeof(path), "/proc/%d/auxv", pid);
+  if (!(f = fopen(path, "re")))
+    return 0;
+  memset(a, 0, sizeof(*a));
+  while (fread(&v, sizeof(v), 1, f) == 1 && v.a_type != AT_NULL)
+    switch (v.a_type)
+      {
+      case AT_PHDR: a->phdr = v.a_un.a_val; break;
+      case AT_PHNUM: a->phnum = v.a_un.a_val; break;
+      case AT_BASE: a->base = v.a_un.a_val; break;
+      case AT_SYSINFO_EHDR: a->vdso = v.a_un.a_val; break;
+      }
+  fclose(f);
+  return 1;
+}
+
+/* The r_debug the dynamic linker has put in the DT_DEBUG entry of
+   the executable's _DYNAMIC, or 0 if it has not run yet. */
+static uint64_t find_rdebug(struct job *j, const struct auxv *a)
+{
+  uint64_t bias = 0, dyn = 0;
+  Elf64_Phdr ph;
+  Elf64_Dyn d;
+
+  for (uint64_t i = 0; i < a->phnum; i++)
+    {
+      if (!read_mem(j, a->phdr + i * sizeof(ph), &ph, sizeof(ph)))
+	return 0;
+      if (ph.p_type == PT_PHDR)
+	bias = a->phdr - ph.p_vaddr;
+      else if (ph.p_type == PT_DYNAMIC)
+	dyn = ph.p_vaddr;
+    }
+  for (int i = 0; dyn && i < MAXDYN; i++)
+    {
+      if (!read_mem(j, bias + dyn + i * sizeof(d), &d, sizeof(d))
+	  || d.d_tag == DT_NULL)
+	break;
+      if (d.d_tag == DT_DEBUG)
+	return d.d_un.d_ptr;
+    }
+  return 0;
+}
+
+static char *remote_string(struct job *j, uint64_t addr)
+{
+  char buf[PATH_MAX];
+  size_t n = 0;
+
+  while (n < sizeof(buf) - 1)
+    {
+      size_t len = MEMPAGE - (addr + n) % MEMPAGE;
+      if (len > sizeof(buf) - 1 - n)
+	len = sizeof(buf) - 1 - n;
+      if (!read_mem(j, addr + n, buf + n, len))
+	return NULL;
+      if (memchr(buf + n, 0, len))
+	return strdup(buf);
+      n += len;
+    }
+  return NULL;
+}
+
+/* The span of the PT_LOAD segments among the n program headers ph,
+   as addresses in the file. */
+static int extent(const Elf64_Phdr *ph, int n, uint64_t *lo, uint64_t *hi)
+{
+  *lo = UINT64_MAX;
+  *hi = 0;
+  for (int i = 0; i < n; i++)
+    if (ph[i].p_type == PT_LOAD)
+      {
+	if (ph[i].p_vaddr < *lo)
+	  *lo = ph[i].p_vaddr & ~(uint64_t)(MEMPAGE - 1);
+	if (ph[i].p_vaddr + ph[i].p_memsz > *hi)
+	  *hi = ph[i].p_vaddr + ph[i].p_memsz;
+      }
+  return *lo < *hi;
+}
+
+/* The same, from the headers of the file at path. */
+static int file_extent(const char *path, uint64_t *lo, uint64_t *hi)
+{
+  Elf64_Ehdr eh;
+  Elf64_Phdr *ph;
+  int fd, ok = 0;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+    return 0;
+  if (pread(fd, &eh, sizeof(eh), 0) == sizeof(eh)
+      && !memcmp(eh.e_ident, ELFMAG, SELFMAG)
+      && (ph = malloc(eh.e_phnum * sizeof(Elf64_Phdr))))
+    {
+      size_t len = eh.e_phnum * sizeof(Elf64_Phdr);
+      ok = pread(fd, ph, len, eh.e_phoff) == len
+	&& extent(ph, eh.e_phnum, lo, hi);
+      free(ph);
+    }
+  close(fd);
+  return ok;
+}
+
+/* Notes path, which it takes, as loaded at bias over lo to hi, unless
+   the list has it already. */
+static void add(struct solibs *s, char *path, uint64_t bias,
+		uint64_t lo, uint64_t hi)
+{
+  struct objfile *o;
+
+  for (int i = 0; i < s->n; i++)
+    {
+      o = &s->o[i];
+      if (o->bias == bias
+	  && (o->path && path ? !strcmp(o->path, path) : o->path == path))
+	{
+	  o->seen = 1;
+	  free(path);
+	  return;
+	}
+    }
+  if (s->n == s->max)
+    {
+      int max = s->max ? 2 * s->max : 16;
+      if (!(o = realloc(s->o, max * sizeof(struct objfile))))
+	{
+	  free(path);
+	  return;
+	}
+      s->o = o;
+      s->max = max;
+    }
+  o = &s->o[s->n++];
+  memset(o, 0, sizeof(*o));
+  o->path = path;
+  o->bias = bias;
+  o->lo = bias + lo;
+  o->hi = bias + hi;
+  o->seen = 1;
+}
+
+/* Adds the objects on the linker's list, noting where it wants the
+   breakpoint.  The executable is the entry with no name, and the
+   vDSO the one whose name is not a path. */
+static int walk_linkmap(struct job *j, struct solibs *s, uint64_t *brk)
+{
+  struct r_debug r;
+  struct link_map lm;
+  uint64_t lo, hi;
+  char *path;
+
+  if (!read_mem(j, s->rdebug, &r, sizeof(r)) || !r.r_map)
+    return 0;
+  *brk = r.r_brk;
+  lm.l_next = r.r_map;
+  for (int i = 0; lm.l_next && i < MAXOBJS; i++)
+    {
+      if (!read_mem(j, (uint64_t)lm.l_next, &lm, sizeof(lm)))
+	return 0;
+      if (!(path = remote_string(j, (uint64_t)lm.l_name)))
+	continue;
+      if (strchr(path, '/') && file_extent(path, &lo, &hi))
+	add(s, path, lm.l_addr, lo, hi);
+      else
+	free(path);
+    }
+  return 1;
+}
+
+/* Adds the files mapped from offset 0, other than the executable. */
+static void walk_maps(struct job *j, struct solibs *s, const struct auxv *a)
+{
+  struct regions *rs = job_regions(j);
+  struct region *r;
+  uint64_t exe = 0, lo, hi;
+  char *path;
+
+  if (!rs)
+    return;
+  if (a->phdr && (r = find_region(rs, a->phdr)))
+    exe = r->inode;
+  for (int i = 0; i < rs->n; i++)
+    {
+      r = &rs->r[i];
+      if (!r->name || r->name[0] != '/' || r->offset || r->inode == exe
+	  || !file_extent(r->name, &lo, &hi) || !(path = strdup(r->name)))
+	continue;
+      add(s, path, r->start - lo, lo, hi);
+    }
+}
+
+static void add_vdso(struct job *j, struct solibs *s, uint64_t base)
+{
+  Elf64_Ehdr eh;
+  Elf64_Phdr ph[16];
+  uint64_t lo, hi;
+
+  if (read_mem(j, base, &eh, sizeof(eh))
+      && !memcmp(eh.e_ident, ELFMAG, SELFMAG) && eh.e_phnum <= 16
+      && read_mem(j, base + eh.e_phoff, ph, eh.e_phnum * sizeof(Elf64_Phdr))
+      && extent(ph, eh.e_phnum, &lo, &hi))
+    add(s, NULL, base - lo, lo, hi);
+}
+
+/* Indexes o's symbols the first time it is asked to, from its file
+   or its debug file, or from a copy of the vDSO out of the job. */
+static int load(struct job *j, struct objfile *o)
+{
+  struct elffile *f = NULL;
+  Elf64_Ehdr eh;
+  char *copy;
+
+  if (o->tried)
+    return o->idx != NULL;
+  o->tried = 1;
+  if (o->path)
+    f = elf_open(AT_FDCWD, o->path);
+  else if (read_mem(j, o->lo, &eh, sizeof(eh)))
+    {
+      /* The section headers come last. */
+      size_t len = eh.e_shoff + eh.e_shnum * sizeof(Elf64_Shdr);
+      if (len <= VDSO_MAX && (copy = malloc(len)))
+	{
+	  if (read_mem(j, o->lo, copy, len))
+	    f = elf_copy(copy, len);
+	  else
+	    free(copy);
+	}
+    }
+  if (f && (f = elf_debug_file(f)))
+    {
+      o->idx = cached_symbols(f);
+      elf_close(f);
+    }
+  return o->idx != NULL;
+}
+
+/* Nonzero if the breakpoint is still there; $$B clears it too. */
+static int armed(struct job *j, struct solibs *s)
+{
+  struct bpt *b;
+
+  return s->brk && (b = find_bpt(&j->proc.bpts, s->brk)) && (b->flags & BPT_SOLIB);
+}
+
+/* Sets the breakpoint on _dl_debug_state: at r_brk once the linker
+   has said where that is, else found in the linker's own symbols. */
+static void arm(struct job *j, struct solibs *s, uint64_t brk,
+		const struct auxv *a)
+{
+  uint64_t v;
+
+  if (armed(j, s))
+    return;
+  s->brk = 0;
+  if (j->state == 'r')
+    return;
+  for (int i = 0; !brk && a->base && i < s->n; i++)
+    {
+      struct objfile *o = &s->o[i];
+      if (o->lo == a->base && load(j, o)
+	  && symbol_value(o->idx, "_dl_debug_state", 15, &v))
+	brk = o->bias + v;
+    }
+  if (brk && set_sbpt(j, brk))
+    s->brk = brk;
+}
+
+/* Walks the job's objects again, keeping those still loaded. */
+static void walk(struct job *j, struct solibs *s)
+{
+  struct auxv a;
+  uint64_t brk = 0;
+  int n = 0;
+
+  for (int i = 0; i < s->n; i++)
+    s->o[i].seen = 0;
+  if (!read_auxv(j->proc.pid, &a))
+    memset(&a, 0, sizeof(a));
+  if (!s->rdebug)
+    s->rdebug = find_rdebug(j, &a);
+  if (!s->rdebug || !walk_linkmap(j, s, &brk))
+    walk_maps(j, s, &a);
+  if (a.vdso)
+    add_vdso(j, s, a.vdso);
+  for (int i = 0; i < s->n; i++)
+    if (s->o[i].seen)
+      s->o[n++] = s->o[i];
+    else
+      drop(&s->o[i]);
+  s->n = n;
+  s->runs = j->proc.runs;
+  s->stale = 0;
+  arm(j, s, brk, &a);
+}
+
+static void drop_all(struct solibs *s)
+{
+  for (int i = 0; i < s->n; i++)
+    drop(&s->o[i]);
+  free(s->o);
+  memset(s, 0, sizeof(*s));
+}
+
+/* j's list, walked again first if it may be out of date. */
+static struct solibs *solibs(struct job *j)
+{
+  struct solibs *s = j->proc.solibs;
+
+  if (!j->proc.pid)
+    return NULL;
+  if (!s && !(s = j->proc.solibs = calloc(1, sizeof(struct solibs))))
+    return NULL;
+  if (s->pid != j->proc.pid)
+    {
+      drop_all(s);
+      s->pid = j->proc.pid;
+      s->stale = 1;
+    }
+  if (s->stale || (s->runs != j->proc.runs && !armed(j, s)))
+    walk(j, s);
+  return s;
+}
+
+/* The name of the symbol of a shared object that addr is in, and how
+   far in. */
+const char *solib_symbol(struct job *j, uint64_t addr, uint64_t *off)
+{
+  struct solibs *s = solibs(j);
+  const struct symbol *sym;
+
+  for (int i = 0; s && i < s->n; i++)
+    {
+      struct objfile *o = &s->o[i];
+      if (addr >= o->lo && addr < o->hi)
+	{
+	  if (!load(j, o) || !(sym = find_symbol(o->idx, addr - o->bias)))
+	    return NULL;
+	  *off = addr - o->bias - sym->addr;
+	  return o->idx->arena + sym->name;
+	}
+    }
+  return NULL;
+}
+
+/* The address of the symbol called name, len characters long, in the
+   first shared object to have one, in the order the linker searches
+   them. */
+int solib_symvalue(struct job *j, const char *name, size_t len, uint64_t *value)
+{
+  struct solibs *s = solibs(j);
+
+  for (int i = 0; s && i < s->n; i++)
+    {
+      struct objfile *o = &s->o[i];
+      if (load(j, o) && symbol_value(o->idx, name, len, value))
+	{
+	  *value += o->bias;
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+/* The job has stopped at _dl_debug_state. */
+void solib_hit(struct job *j)
+{
+  if (j->proc.solibs)
+    j->proc.solibs->stale = 1;
+}
+
+void release_solibs(struct job *j)
+{
+  if (j->proc.solibs)
+    {
+      drop_all(j->proc.solibs);
+      free(j->proc.solibs);
+      j->proc.solibs = NULL;
+    }
+}
@@ -0,0 +1,332 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <stddef.h>
+#include <sys/ptrace.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <linux/audit.h>
+#include "jobs.h"
+#include "debugger.h"
+#include "bpt.h"
+#include "record.h"
+#include "strace.h"
+
+/* :strace <syscalls> types the chosen system calls of the job, with
+   their arguments, value and time, and records them if :record is
+   on.  Instead of stopping the job at every call with PTRACE_SYSCALL
+   the job is made to install a seccomp filter that returns
+   SECCOMP_RET_TRACE for just those calls, so the others run at full
+   speed.  DDT then sees a PTRACE_EVENT_SECCOMP stop at the entry of
+   each chosen call and resumes with PTRACE_SYSCALL to see its exit.
+
+   A filter cannot be taken back, and neither can the NO_NEW_PRIVS
+   it needs; a later :strace with fewer calls only stops typing the
+   others, whose stops are resumed at once.  A job left running
+   without DDT gets ENOSYS from the filtered calls.  A filter cannot
+   read the job's memory, so there is no flag to turn it off with;
+   instead DDT says so when it installs the first one and again when
+   it lets go of the job. */
+
+#define MAXFILTER 255		/* calls in one filter, for 8 bit jumps */
+
+struct strace {
+  uint64_t want[NSYSCALLS / 64];	/* calls typed */
+  uint64_t filtered[NSYSCALLS / 64];	/* calls the filters trace */
+  int inside;			/* stopped at the entry of nr */
+  int nr;
+  uint64_t args[6];
+  uint64_t start;
+};
+
+#define HAS(set, nr) ((set)[(nr) / 64] >> ((nr) % 64) & 1)
+
+struct sysname {
+  const char *name;
+  int nr;
+};
+
+#define SYSCALL(name) { #name, SYS_##name },
+static const struct sysname sysnames[] = {
+#include "syscalls.h"
+};
+#define NNAMES (sizeof(sysnames) / sizeof(sysnames[0]))
+
+static const char *namesbynr[NSYSCALLS];
+
+static int byname(const void *key, const void *elem)
+{
+  return strcmp(key, ((const struct sysname *)elem)->name);
+}
+
+static int sysnr(const char *name)
+{
+  const struct sysname *s;
+  char *end;
+  long nr;
+
+  if (isdigit((unsigned char)*name))
+    {
+      nr = strtol(name, &end, 0);
+      return *end || nr >= NSYSCALLS ? -1 : nr;
+    }
+  s = bsearch(name, sysnames, NNAMES, sizeof(struct sysname), byname);
+  return s && s->nr < NSYSCALLS ? s->nr : -1;
+}
+
+static const char *sysname(int nr)
+{
+  if (!namesbynr[0])
+    for (size_t i = 0; i < NNAMES; i++)
+      if (sysnames[i].nr < NSYSCALLS)
+	namesbynr[sysnames[i].nr] = sysnames[i].name;
+  return nr >= 0 && nr < NSYSCALLS && namesbynr[nr] ? namesbynr[nr] : "?";
+}
+
+static uint64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Make the stopped job j install a filter tracing the n calls in
+   nrs, by remote system calls.  The program goes in trampoline
+   space. */
+static int install_filter(struct job *j, const int *nrs, int n)
+{
+  struct sock_filter prog[MAXFILTER + 6];
+  struct sock_fprog fprog;
+  struct user_regs_struct *regs;
+  uint64_t where;
+  long r;
+  int k = 0;
+
+  prog[k++] = (struct sock_filter)
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+  prog[k++] = (struct sock_filter)
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0);
+  prog[k++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+  prog[k++] = (struct sock_filter)
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+  for (int i = 0; i < n; i++)
+    prog[k++] = (struct sock_filter)
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, nrs[i], n - i, 0);
+  prog[k++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+  prog[k++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE);
+
+  if (!(regs = job_regs(j))
+      || !(where = tramp_space(j, regs->rip, sizeof(fprog) + k * sizeof(prog[0]))))
+    return 0;
+  fprog.len = k;
+  fprog.filter = (struct sock_filter *)(where + sizeof(fprog));
+  if (!patch_mem(j, where, &fprog, sizeof(fprog))
+      || !patch_mem(j, where + sizeof(fprog), prog, k * sizeof(prog[0])))
+    return 0;
+
+  if ((r = remote_syscall(j, SYS_prctl, PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0, 0)) == 0)
+    r = remote_syscall(j, SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, where, 0, 0, 0);
+  if (r)
+    {
+      errno = r < 0 ? -r : EIO;
+      return 0;
+    }
+  return 1;
+}
+
+void strace(char *arg)
+{
+  struct job *j = currjob;
+  struct strace *st;
+  uint64_t want[NSYSCALLS / 64] = { 0 };
+  int nrs[MAXFILTER], n = 0, nwant = 0;
+  char *name;
+
+  if (!j || !j->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  if (!*arg)
+    {
+      if (j->proc.strace)
+	memset(j->proc.strace->want, 0, sizeof(want));
+      fputs("\r\nsystem calls not traced\r\n", stderr);
+      return;
+    }
+  if (j->state == 'r')
+    {
+      fputs(" job running? ", stderr);
+      return;
+    }
+  if (!j->proc.strace && !(j->proc.strace = calloc(1, sizeof(struct strace))))
+    {
+      errout("strace");
+      return;
+    }
+  st = j->proc.strace;
+
+  for (name = strtok(arg, ", "); name; name = strtok(NULL, ", "))
+    {
+      int nr = sysnr(name);
+      if (nr < 0)
+	{
+	  fprintf(stderr, " %s? ", name);
+	  return;
+	}
+      if (HAS(want, nr))
+	continue;
+      want[nr / 64] |= 1ULL << (nr % 64);
+      nwant++;
+      if (!HAS(st->filtered, nr))
+	{
+	  if (n == MAXFILTER)
+	    {
+	      fputs(" too many? ", stderr);
+	      return;
+	    }
+	  nrs[n++] = nr;
+	}
+    }
+
+  if (n && !install_filter(j, nrs, n))
+    {
+      errout("seccomp");
+      return;
+    }
+  if (n && !strace_filtered(j))
+    fputs("\r\nthe filter stays: without DDT these calls will fail with ENOSYS",
+	  stderr);
+  for (int i = 0; i < n; i++)
+    st->filtered[nrs[i] / 64] |= 1ULL << (nrs[i] % 64);
+  memcpy(st->want, want, sizeof(want));
+  fprintf(stderr, "\r\ntracing %d system calls\r\n", nwant);
+}
+
+/* Whether j has a filter of ours, which outlives DDT. */
+int strace_filtered(struct job *j)
+{
+  struct strace *st = j->proc.strace;
+
+  if (st)
+    for (int i = 0; i < NSYSCALLS / 64; i++)
+      if (st->filtered[i])
+	return 1;
+  return 0;
+}
+
+static void typecall(struct strace *st, int64_t ret, uint64_t dt)
+{
+  int nargs = 6;
+
+  while (nargs && !st->args[nargs - 1])
+    nargs--;
+  fprintf(stderr, "%s(", sysname(st->nr));
+  for (int i = 0; i < nargs; i++)
+    fprintf(stderr, i ? ", %lx" : "%lx", st->args[i]);
+  if (ret < 0 && ret > -4096)
+    fprintf(stderr, ") = -1 %s", strerror(-ret));
+  else
+    fprintf(stderr, ") = %lx", ret);
+  fprintf(stderr, "  %.6f\r\n", dt / 1e9);
+}
+
+/* Notes the entry of a call j is stopped at, if it is one to type.
+   Returns 1 if it is, 0 if not, -1 if the stop could not be looked
+   at. */
+static int enter(struct job *j, struct __ptrace_syscall_info *si)
+{
+  struct strace *st = j->proc.strace;
+
+  if (ptrace(PTRACE_GET_SYSCALL_INFO, j->proc.pid, sizeof(*si), si) <= 0)
+    return -1;
+  if (si->op == PTRACE_SYSCALL_INFO_SECCOMP && st
+      && si->seccomp.nr < NSYSCALLS && HAS(st->want, si->seccomp.nr))
+    {
+      st->inside = 1;
+      st->nr = si->seccomp.nr;
+      memcpy(st->args, si->seccomp.args, sizeof(st->args));
+      record_syscall(j, si->instruction_pointer, st->nr, st->args);
+      st->start = now();
+      return 1;
+    }
+  return 0;
+}
+
+/* Types the call j was inside of, which returned ret. */
+void strace_return(struct job *j, int64_t ret)
+{
+  struct strace *st = j->proc.strace;
+
+  if (st && st->inside)
+    {
+      typecall(st, ret, now() - st->start);
+      record_sysret(j, st->nr, ret);
+      st->inside = 0;
+    }
+}
+
+/* Called by step_insn() at a seccomp stop met while stepping j.  The
+   step goes on through the call; if this returns 1, strace_return()
+   is to type it after. */
+int strace_step(struct job *j)
+{
+  struct __ptrace_syscall_info si;
+  int r;
+
+  if ((r = enter(j, &si)) == -1)
+    errout("syscall info");
+  return r == 1;
+}
+
+/* Called by job_trap() at a seccomp stop or a system call exit stop.
+   Notes the entry or types the call, and resumes the job. */
+int strace_stop(struct job *j)
+{
+  struct __ptrace_syscall_info si;
+  int ok, r;
+
+  if ((r = enter(j, &si)) == -1)
+    {
+      errout("syscall info");
+      return STOP_TRAP;
+    }
+  if (r)
+    ok = cont_syscall(j);
+  else
+    {
+      if (si.op == PTRACE_SYSCALL_INFO_EXIT)
+	strace_return(j, si.exit.rval);
+      ok = cont_job(j);
+    }
+  if (ok)
+    return STOP_RESUMED;
+  errout("ptrace cont");
+  return STOP_TRAP;
+}
@@ -0,0 +1,438 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "elffile.h"
+#include "symbols.h"
+
+#define SYM_SLOP 0x1000		/* how far past a symbol of no size */
+
+static int symcmp(const void *a, const void *b)
+{
+  const struct symbol *x = a, *y = b;
+
+  if (x->addr != y->addr)
+    return x->addr < y->addr ? -1 : 1;
+  /* Of several at one address, the one with a size, then the
+     longest, comes first and is kept. */
+  if (x->size != y->size)
+    return x->size > y->size ? -1 : 1;
+  return 0;
+}
+
+/* Fills eyt[k] and its subtrees from sym[i] on, in order, returning
+   the next i. */
+static int eytzinger(struct symindex *x, int i, int k)
+{
+  if (k <= x->n)
+    {
+      i = eytzinger(x, i, 2 * k);
+      x->eyt[k] = x->sym[i].addr;
+      x->rank[k] = i++;
+      i = eytzinger(x, i, 2 * k + 1);
+    }
+  return i;
+}
+
+void free_symindex(struct symindex *x)
+{
+  if (x && x->map)
+    {
+      munmap(x->map, x->maplen);
+      free(x);
+    }
+  else if (x)
+    {
+      free(x->sym);
+      free(x->eyt);
+      free(x->rank);
+      free(x->names);
+      free(x->arena);
+      free(x);
+    }
+}
+
+/* FNV-1a. */
+static uint32_t hash(const char *s, size_t len)
+{
+  uint32_t h = 2166136261u;
+
+  while (len--)
+    h = (h ^ (unsigned char)*s++) * 16777619u;
+  return h;
+}
+
+/* The slot for name, either holding it or free. */
+static struct symname *probe(const struct symindex *x, const char *name,
+			     size_t len, uint32_t h)
+{
+  for (uint32_t i = h & x->mask;; i = (i + 1) & x->mask)
+    {
+      struct symname *e = &x->names[i];
+      if (!e->name
+	  || (e->hash == h && !strncmp(x->arena + e->name, name, len)
+	      && !x->arena[e->name + len]))
+	return e;
+    }
+}
+
+static int named(const Elf64_Sym *s, size_t strsz)
+{
+  int type = ELF64_ST_TYPE(s->st_info);
+
+  return s->st_name && s->st_name < strsz && s->st_shndx != SHN_UNDEF
+    && type != STT_SECTION && type != STT_FILE;
+}
+
+/* Fills the name table from the n symbols s with names in str, strsz
+   bytes long.  Of several of a name, a global one wins, else the
+   first. */
+static int hash_names(struct symindex *x, const Elf64_Sym *s, size_t n,
+		      const char *str, size_t strsz)
+{
+  size_t count = 0, bytes = 1, size = 2;
+
+  for (size_t i = 0; i < n; i++)
+    if (named(&s[i], strsz))
+      {
+	count++;
+	bytes += strlen(str + s[i].st_name) + 1;
+      }
+  while (size < 2 * count)
+    size *= 2;
+  if (bytes > UINT32_MAX
+      || !(x->names = calloc(size, sizeof(struct symname)))
+      || !(x->arena = malloc(bytes)))
+    return 0;
+  x->mask = size - 1;
+  x->arena[0] = 0;
+  bytes = 1;
+
+  for (int local = 0; local < 2; local++)
+    for (size_t i = 0; i < n; i++)
+      {
+	if (!named(&s[i], strsz) || (ELF64_ST_BIND(s[i].st_info) == STB_LOCAL) != local)
+	  continue;
+	const char *name = str + s[i].st_name;
+	size_t len = strlen(name);
+	uint32_t h = hash(name, len);
+	struct symname *e = probe(x, name, len, h);
+	if (e->name)
+	  continue;
+	memcpy(x->arena + bytes, name, len + 1);
+	e->hash = h;
+	e->name = bytes;
+	e->value = s[i].st_value;
+	bytes += len + 1;
+      }
+  x->arenalen = bytes;
+  return 1;
+}
+
+/* The value of the symbol called name, len characters long. */
+int symbol_value(const struct symindex *x, const char *name, size_t len,
+		 uint64_t *value)
+{
+  const struct symname *e;
+
+  if (!x || !x->names || !(e = probe(x, name, len, hash(name, len)))->name)
+    return 0;
+  *value = e->value;
+  return 1;
+}
+
+/* Builds the index of the ELF file f from its symbol table, or its
+   dynamic one if it was stripped as shared objects usually are.
+   Returns NULL if it has neither or memory runs out. */
+struct symindex *index_symbols(struct elffile *f)
+{
+  struct symindex *x;
+  int sec, strsec;
+
+  if (!(sec = elf_find(f, SHT_SYMTAB, NULL))
+      && !(sec = elf_find(f, SHT_DYNSYM, NULL)))
+    return NULL;
+  strsec = f->shdr[sec].sh_link;
+
+  const Elf64_Sym *s = elf_section(f, sec);
+  const char *str = elf_section(f, strsec);
+  size_t nsyms = f->shdr[sec].sh_size / sizeof(Elf64_Sym);
+  size_t strsz = f->shdr[strsec].sh_size;
+
+  if (!s || !str || str[strsz - 1]
+      || !(x = calloc(1, sizeof(struct symindex))))
+    return NULL;
+  if (!hash_names(x, s, nsyms, str, strsz)
+      || !(x->sym = calloc(nsyms, sizeof(struct symbol))))
+    goto fail;
+  for (size_t i = 0; i < nsyms; i++)
+    {
+      int type = ELF64_ST_TYPE(s[i].st_info);
+      if ((type != STT_FUNC && type != STT_OBJECT && type != STT_GNU_IFUNC)
+	  || !named(&s[i], strsz) || !s[i].st_value)
+	continue;
+      const char *name = str + s[i].st_name;
+      size_t len = strlen(name);
+      x->sym[x->n].addr = s[i].st_value;
+      x->sym[x->n].size = s[i].st_size;
+      x->sym[x->n].name = probe(x, name, len, hash(name, len))->name;
+      x->n++;
+    }
+  qsort(x->sym, x->n, sizeof(struct symbol), symcmp);
+  int n = 0;
+  for (int i = 0; i < x->n; i++)
+    if (!n || x->sym[i].addr != x->sym[n - 1].addr)
+      x->sym[n++] = x->sym[i];
+  x->n = n;
+
+  if (!(x->eyt = aligned_alloc(64, ((x->n + 1) * sizeof(uint64_t) + 63) & ~63UL))
+      || !(x->rank = malloc((x->n + 1) * sizeof(uint32_t))))
+    goto fail;
+  eytzinger(x, 0, 1);
+
+  x->lo = UINT64_MAX;
+  for (int i = 0; i < f->ehdr.e_phnum; i++)
+    if (f->phdr[i].p_type == PT_LOAD && f->phdr[i].p_vaddr < x->lo)
+      x->lo = f->phdr[i].p_vaddr & ~(uint64_t)0xfff;
+  if (x->lo == UINT64_MAX)
+    x->lo = 0;
+  x->pie = f->ehdr.e_type == ET_DYN;
+  return x;
+
+ fail:
+  free_symindex(x);
+  return NULL;
+}
+
+/* The symbol addr falls in, by file address, or NULL.  The walk down
+   eyt[] finds the first address above addr; the symbol before that
+   one in sorted order is the candidate. */
+const struct symbol *find_symbol(const struct symindex *x, uint64_t addr)
+{
+  uint64_t k = 1;
+  const struct symbol *s;
+
+  if (!x || !x->n)
+    return NULL;
+  while (k <= (uint64_t)x->n)
+    {
+      __builtin_prefetch(x->eyt + 8 * k);	/* three levels down */
+      k = 2 * k + (x->eyt[k] <= addr);
+    }
+  k >>= __builtin_ffsll(~k);
+  uint32_t r = k ? x->rank[k] : (uint32_t)x->n;
+  if (!r)
+    return NULL;
+  s = &x->sym[r - 1];
+  if (addr - s->addr < (s->size ? s->size : SYM_SLOP))
+    return s;
+  return NULL;
+}
+
+/* The cache.  An index is written to $XDG_CACHE_HOME/ddt/<build-id>,
+   or ~/.cache/ddt/<build-id>, as a header and then its arrays, each
+   aligned as it wants, and mapped back read only with nothing to
+   parse.  The file holds the build-id as well as being named for it,
+   and is written under another name and renamed into place, so a
+   half written one or one of another build is never used. */
+
+#define CACHE_MAGIC "DDTSYMS2"
+#define MAXID 64
+
+#define CACHE_PIE 1
+#define CACHE_SYMTAB 2		/* from .symtab, not just .dynsym */
+
+struct cachehdr {
+  char magic[8];
+  uint32_t idlen;
+  uint8_t id[MAXID];
+  int32_t n;
+  uint32_t mask;
+  uint32_t flags;		/* CACHE_ bits */
+  uint64_t lo;
+  uint64_t sym;			/* offsets in the file */
+  uint64_t eyt;
+  uint64_t rank;
+  uint64_t names;
+  uint64_t arena;
+  uint64_t arenalen;
+  uint64_t size;
+};
+
+/* The cache file for build-id id, making its directory if make. */
+static int cache_path(char *path, size_t size, const uint8_t *id,
+		      size_t idlen, int make)
+{
+  const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+  size_t n;
+
+  if (xdg && *xdg == '/')
+    n = snprintf(path, size, "%s", xdg);
+  else if (home && *home)
+    n = snprintf(path, size, "%s/.cache", home);
+  else
+    return 0;
+  if (make)
+    mkdir(path, 0700);
+  n += snprintf(path + n, n < size ? size - n : 0, "/ddt");
+  if (make)
+    mkdir(path, 0755);
+  if (n + 2 * idlen + 2 > size)
+    return 0;
+  path[n++] = '/';
+  for (size_t i = 0; i < idlen; i++)
+    n += sprintf(path + n, "%02x", id[i]);
+  return 1;
+}
+
+static uint64_t align(uint64_t off, uint64_t to)
+{
+  return (off + to - 1) & ~(to - 1);
+}
+
+/* Where the arrays of an index with h's sizes go, and the size of the
+   whole file. */
+static void layout(struct cachehdr *h)
+{
+  h->sym = align(sizeof(struct cachehdr), 8);
+  h->eyt = align(h->sym + h->n * sizeof(struct symbol), 64);
+  h->rank = h->eyt + (h->n + 1) * sizeof(uint64_t);
+  h->names = align(h->rank + (h->n + 1) * sizeof(uint32_t), 8);
+  h->arena = h->names + ((uint64_t)h->mask + 1) * sizeof(struct symname);
+  h->size = h->arena + h->arenalen;
+}
+
+static struct symindex *map_cache(const char *path, const uint8_t *id,
+				  size_t idlen, unsigned flags)
+{
+  struct cachehdr h, *m;
+  struct symindex *x;
+  struct stat st;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+    return NULL;
+  if (fstat(fd, &st) == -1 || st.st_size < sizeof(h)
+      || (m = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+      close(fd);
+      return NULL;
+    }
+  close(fd);
+
+  /* Trust nothing in the header that layout() does not reproduce. */
+  h = *m;
+  layout(&h);
+  if (memcmp(m->magic, CACHE_MAGIC, 8) || m->idlen != idlen
+      || memcmp(m->id, id, idlen) || (m->flags & CACHE_SYMTAB) != flags
+      || m->n < 0 || (m->mask & (m->mask + 1))
+      || memcmp(&h, m, sizeof(h)) || h.size != st.st_size || !h.arenalen
+      || ((char *)m)[h.size - 1]
+      || !(x = calloc(1, sizeof(struct symindex))))
+    {
+      munmap(m, st.st_size);
+      return NULL;
+    }
+  x->n = h.n;
+  x->sym = (struct symbol *)((char *)m + h.sym);
+  x->eyt = (uint64_t *)((char *)m + h.eyt);
+  x->rank = (uint32_t *)((char *)m + h.rank);
+  x->lo = h.lo;
+  x->pie = h.flags & CACHE_PIE;
+  x->names = (struct symname *)((char *)m + h.names);
+  x->mask = h.mask;
+  x->arena = (char *)m + h.arena;
+  x->arenalen = h.arenalen;
+  x->map = m;
+  x->maplen = h.size;
+  return x;
+}
+
+static int put(int fd, const void *buf, size_t len, off_t off)
+{
+  const char *p = buf;
+  ssize_t n;
+
+  for (; len; p += n, len -= n, off += n)
+    if ((n = pwrite(fd, p, len, off)) <= 0)
+      return 0;
+  return 1;
+}
+
+static void write_cache(const char *path, const struct symindex *x,
+			const uint8_t *id, size_t idlen, unsigned flags)
+{
+  struct cachehdr h;
+  char tmp[PATH_MAX];
+  int fd, ok;
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, CACHE_MAGIC, 8);
+  h.idlen = idlen;
+  memcpy(h.id, id, idlen);
+  h.n = x->n;
+  h.mask = x->mask;
+  h.flags = flags | (x->pie ? CACHE_PIE : 0);
+  h.lo = x->lo;
+  h.arenalen = x->arenalen;
+  layout(&h);
+
+  if (snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid()) >= sizeof(tmp)
+      || (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+    return;
+  ok = ftruncate(fd, h.size) == 0
+    && put(fd, &h, sizeof(h), 0)
+    && put(fd, x->sym, x->n * sizeof(struct symbol), h.sym)
+    && put(fd, x->eyt, (x->n + 1) * sizeof(uint64_t), h.eyt)
+    && put(fd, x->rank, (x->n + 1) * sizeof(uint32_t), h.rank)
+    && put(fd, x->names, ((uint64_t)x->mask + 1) * sizeof(struct symname), h.names)
+    && put(fd, x->arena, x->arenalen, h.arena);
+  close(fd);
+  if (!ok || rename(tmp, path) == -1)
+    unlink(tmp);
+}
+
+/* The index of the ELF file f, from the cache if it has one for the
+   file's build-id, else built and put in the cache.  A cache made
+   before a debug file with a symbol table was installed is not used
+   for that. */
+struct symindex *cached_symbols(struct elffile *f)
+{
+  const uint8_t *id;
+  size_t idlen = elf_build_id(f, &id);
+  unsigned flags = elf_find(f, SHT_SYMTAB, NULL) ? CACHE_SYMTAB : 0;
+  char path[PATH_MAX];
+  struct symindex *x;
+
+  if (!idlen || idlen > MAXID || !cache_path(path, sizeof(path), id, idlen, 0))
+    return index_symbols(f);
+  if ((x = map_cache(path, id, idlen, flags)))
+    return x;
+  if ((x = index_symbols(f)) && cache_path(path, sizeof(path), id, idlen, 1))
+    write_cache(path, x, id, idlen, flags);
+  return x;
+}
@@ -0,0 +1,61 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+struct symbol {
+  uint64_t addr;		/* as in the file, before any load bias */
+  uint64_t size;
+  uint32_t name;		/* offset in the arena */
+};
+
+/* A slot of the name table. */
+struct symname {
+  uint32_t hash;
+  uint32_t name;		/* offset in the arena, 0 if free */
+  uint64_t value;		/* as in the file */
+};
+
+/* Function and object symbols sorted by address, with the addresses
+   also laid out in Eytzinger order, the sorted array as an implicit
+   binary tree stored breadth first: a lookup walks down from eyt[1]
+   touching one cache line per few levels, and can prefetch ahead.
+   Then every named symbol in an open addressed hash table, its name
+   copied into one arena.  Nothing holds a pointer, so the whole index
+   can be written to a cache file and mapped back as it is. */
+struct symindex {
+  int n;
+  struct symbol *sym;		/* n, sorted by addr */
+  uint64_t *eyt;		/* n + 1, eyt[0] unused */
+  uint32_t *rank;		/* index in sym of each eyt[] */
+  uint64_t lo;			/* lowest PT_LOAD address */
+  int pie;			/* ET_DYN, loaded at a bias */
+  struct symname *names;	/* mask + 1 slots, a power of two */
+  uint32_t mask;
+  char *arena;
+  size_t arenalen;
+  void *map;			/* the cache file it is in, if any */
+  size_t maplen;
+};
+
+struct elffile;
+
+struct symindex *index_symbols(struct elffile *f);
+struct symindex *cached_symbols(struct elffile *f);
+void free_symindex(struct symindex *x);
+const struct symbol *find_symbol(const struct symindex *x, uint64_t addr);
+int symbol_value(const struct symindex *x, const char *name, size_t len,
+		 uint64_t *value);
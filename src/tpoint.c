@@ -0,0 +1,272 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "jobs.h"
+#include "debugger.h"
+#include "aeval.h"
+#include "bpt.h"
+#include "tpoint.h"
+
+/* Tracepoints.  :tpoint <addr> <exprs> puts a jmp at addr to a
+   trampoline that stores the values of exprs in the next slot of a
+   ring and goes on, see cond.c.  The ring is a memfd mapped both in
+   the job and in DDT, where a thread drains it every few
+   milliseconds into a log of the last TP_LOG hits; :tpoint alone
+   types what came in since last time.  Slots the job laps before
+   they are drained are counted as dropped. */
+
+#define RINGSIZE (TP_HEAD + TP_SLOTS * sizeof(struct tpslot))
+#define DRAIN_NS 10000000
+
+struct tring {
+  struct tring *next;
+  char *map;			/* the ring, as DDT sees it */
+  uint64_t remote;		/* and where the job has it */
+  uint64_t tail;		/* next slot to drain */
+  uint64_t dropped;
+  uint64_t nlog;		/* hits ever put in log */
+  uint64_t shown;		/* hits typed */
+  struct tpslot log[TP_LOG];
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tring *rings;
+
+static void drain(struct tring *r)
+{
+  struct tpslot *slots = (struct tpslot *)(r->map + TP_HEAD);
+  uint64_t head = __atomic_load_n((uint64_t *)r->map, __ATOMIC_ACQUIRE);
+
+  if (head - r->tail > TP_SLOTS)
+    {
+      r->dropped += head - TP_SLOTS - r->tail;
+      r->tail = head - TP_SLOTS;
+    }
+  while (r->tail != head)
+    {
+      struct tpslot *s = &slots[r->tail & (TP_SLOTS - 1)];
+      uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+      if (seq <= r->tail)
+	break;			/* claimed, not filled yet */
+      if (seq == r->tail + 1)
+	{
+	  memcpy(&r->log[r->nlog % TP_LOG], s, sizeof(struct tpslot));
+	  /* A writer that lapped us zeroes seq before the values. */
+	  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+	  if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) == seq)
+	    r->nlog++;
+	  else
+	    r->dropped++;
+	}
+      else
+	r->dropped++;		/* lapped */
+      r->tail++;
+    }
+}
+
+static void *drainer(void *unused)
+{
+  struct timespec ts = { 0, DRAIN_NS };
+
+  for (;;)
+    {
+      pthread_mutex_lock(&lock);
+      for (struct tring *r = rings; r; r = r->next)
+	drain(r);
+      pthread_mutex_unlock(&lock);
+      nanosleep(&ts, NULL);
+    }
+  return NULL;
+}
+
+/* Make the ring of the stopped job j: the job creates the memfd and
+   maps it, and DDT maps it through /proc/<pid>/fd.  On failure the
+   job is left as it was, but for a trampoline page. */
+static struct tring *new_tring(struct job *j, uint64_t near)
+{
+  static const char name[] = "ddt-tpoint";
+  static int started;
+  struct bpts *bs = &j->proc.bpts;
+  struct tring *r;
+  uint64_t where;
+  char path[64];
+  long fd, got = -1;
+  int local = -1, e;
+
+  if (!(where = tramp_space(j, near, sizeof(name))))
+    return NULL;
+  if (!patch_mem(j, where, name, sizeof(name)))
+    goto fail;
+  if ((fd = remote_syscall(j, SYS_memfd_create, where, MFD_CLOEXEC, 0, 0, 0, 0)) < 0)
+    {
+      errno = -fd;
+      goto fail;
+    }
+  if ((got = remote_syscall(j, SYS_ftruncate, fd, RINGSIZE, 0, 0, 0, 0)) == 0)
+    got = remote_syscall(j, SYS_mmap, 0, RINGSIZE, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, fd, 0);
+  snprintf(path, sizeof(path), "/proc/%d/fd/%ld", j->proc.pid, fd);
+  local = open(path, O_RDWR | O_CLOEXEC);
+  remote_syscall(j, SYS_close, fd, 0, 0, 0, 0, 0);
+  if (got < 0 && got > -4096)
+    {
+      errno = -got;
+      got = -1;
+      goto fail;
+    }
+  if (local == -1 || !(r = calloc(1, sizeof(struct tring))))
+    goto fail;
+  r->remote = got;
+  if ((r->map = mmap(NULL, RINGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+		     local, 0)) == MAP_FAILED)
+    {
+      free(r);
+      goto fail;
+    }
+  close(local);
+
+  pthread_mutex_lock(&lock);
+  r->next = rings;
+  rings = r;
+  if (!started)
+    {
+      pthread_t t;
+      started = pthread_create(&t, NULL, drainer, NULL) == 0;
+      if (started)
+	pthread_detach(t);
+    }
+  pthread_mutex_unlock(&lock);
+  return r;
+
+ fail:
+  e = errno;
+  if (local != -1)
+    close(local);
+  if (got != -1)
+    remote_syscall(j, SYS_munmap, got, RINGSIZE, 0, 0, 0, 0);
+  if (bs->tramp == where + sizeof(name))
+    bs->tramp = where;
+  errno = e;
+  return NULL;
+}
+
+void release_tring(struct job *j)
+{
+  struct tring *r = j->proc.tring;
+
+  if (!r)
+    return;
+  pthread_mutex_lock(&lock);
+  for (struct tring **p = &rings; *p; p = &(*p)->next)
+    if (*p == r)
+      {
+	*p = r->next;
+	break;
+      }
+  pthread_mutex_unlock(&lock);
+  munmap(r->map, RINGSIZE);
+  free(r);
+  j->proc.tring = NULL;
+}
+
+/* Type the hits logged since last time, oldest first. */
+static void typelog(struct tring *r)
+{
+  pthread_mutex_lock(&lock);
+  drain(r);
+  uint64_t i = r->shown;
+  if (r->nlog - i > TP_LOG)
+    i = r->nlog - TP_LOG;
+  fputs("\r\n", stderr);
+  for (; i < r->nlog; i++)
+    {
+      struct tpslot *s = &r->log[i % TP_LOG];
+      int nv = TP_NVALS(s->n);
+      fprintf(stderr, "$%dB", TP_N(s->n));
+      for (int k = 0; k < nv && k < TP_VALS; k++)
+	fprintf(stderr, "\t%lx", s->v[k]);
+      fputs("\r\n", stderr);
+    }
+  fprintf(stderr, "%lu hits, %lu dropped\r\n", r->nlog, r->dropped);
+  r->shown = r->nlog;
+  pthread_mutex_unlock(&lock);
+}
+
+void tpoint(char *arg)
+{
+  struct job *j = currjob;
+  uint64_t addr;
+  char *exprs;
+  int n;
+
+  if (!j || !j->proc.pid)
+    {
+      fputs(" job? ", stderr);
+      return;
+    }
+  if (!*arg)
+    {
+      if (j->proc.tring)
+	typelog(j->proc.tring);
+      else
+	fputs(" no tracepoints? ", stderr);
+      return;
+    }
+  if (j->state == 'r')
+    {
+      fputs(" job running? ", stderr);
+      return;
+    }
+  if (!(exprs = evalexpr(arg, &addr)) || (*exprs && *exprs != ' '))
+    {
+      fputs(" address? ", stderr);
+      return;
+    }
+  while (*exprs == ' ')
+    exprs++;
+
+  if (!j->proc.tring && !(j->proc.tring = new_tring(j, addr)))
+    {
+      errout("tpoint ring");
+      return;
+    }
+  if ((n = set_tpoint(j, addr, exprs, j->proc.tring->remote)))
+    fprintf(stderr, "\r\n$%dB\r\n", n);
+  else if (errno == EINVAL)
+    fputs(" bad expression? ", stderr);
+  else if (errno == ENOEXEC)
+    fputs(" can't move the code there? ", stderr);
+  else if (errno == EBUSY)
+    fputs(" another breakpoint in the way? ", stderr);
+  else if (errno == EAGAIN)
+    fputs(" job stopped in the code to be moved? ", stderr);
+  else
+    errout("tpoint");
+}
@@ -0,0 +1,37 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* A job's tracepoint ring: a page whose first word counts the slots
+   ever claimed, then TP_SLOTS slots the trampolines fill in turn. */
+
+#define TP_SLOTS 65536		/* a power of two */
+#define TP_HEAD 4096		/* offset of the slots */
+#define TP_VALS 6		/* values a tracepoint logs */
+#define TP_LOG 4096		/* hits DDT keeps for :tpoint */
+
+struct tpslot {
+  uint64_t seq;			/* claim number + 1 once filled, 0 while */
+  uint64_t n;			/* tracepoint, as in $<n>B, and how... */
+  uint64_t v[TP_VALS];		/* ...many of these it logged */
+};
+
+#define TP_N(n) ((int)((n) & 0xffffff))
+#define TP_NVALS(n) ((int)((n) >> 24))
+
+void tpoint(char *);
+void release_tring(struct job *j);
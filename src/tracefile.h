@@ -0,0 +1,53 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* :record trace file: a header, then events.  Each event is a type
+   byte followed by unsigned LEB128 numbers: the nanoseconds since
+   the previous event, for the types with a pc the difference from
+   the previous pc (zigzag coded), then the numbers of the type.
+   ddt-trace decodes it. */
+
+#define TRACE_MAGIC "DDTTRACE"
+#define TRACE_VERSION 1
+
+struct tracehdr {
+  char magic[8];
+  uint32_t version;
+  uint32_t pid;
+  uint64_t start;		/* CLOCK_REALTIME ns when recording began */
+};
+
+#define EV_STEP 1		/* pc */
+#define EV_BPT 2		/* pc, breakpoint number */
+#define EV_SIGNAL 3		/* pc, signal */
+#define EV_SYSCALL 4		/* pc, number, six arguments */
+#define EV_SYSRET 5		/* number, return value (zigzag) */
+#define EV_EXIT 6		/* wait status */
+#define EV_MAX 6
+
+#define EV_MAXLEN (1 + 10 * 9)	/* longest event */
+
+static inline uint64_t zigzag(int64_t v)
+{
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
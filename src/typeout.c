@@ -2,9 +2,13 @@
 #include <stdio.h>
 #include <ctype.h>
 #include "typeout.h"
+#include "jobs.h"
+#include "debugger.h"
 
-typeoutfunc *mperce = tmc;	/* tms */
-typeoutfunc *mamper = tmc;	/* tmsq */
+#define STRMAX 256
+
+typeoutfunc *mperce = tms;
+typeoutfunc *mamper = tms;	/* no SQUOZE here */
 typeoutfunc *mdolla = tmc;	/* tms */
 typeoutfunc *mprime = tmc;	/* tm6 */
 typeoutfunc *mdquot = tma;
@@ -34,9 +38,25 @@ static void outchar(unsigned char c)
 
 void tma(uint64_t value)
 {
-  unsigned char *str = (char *)value;
-  for (int i = 0; str[i]; i++)
-    outchar(str[i]);
+  unsigned char str[64];
+  int n = 0;
+
+  while (n < STRMAX)
+    {
+      uint64_t a = value + n;
+      size_t len = sizeof(str) - (a % sizeof(str));
+      if (!read_mem(currjob, a, str, len))
+	{
+	  fputs("?", stderr);
+	  break;
+	}
+      size_t i;
+      for (i = 0; i < len && str[i]; i++)
+	outchar(str[i]);
+      if (i < len)
+	break;
+      n += len;
+    }
   fputs("   ", stderr);
 }
 
@@ -98,6 +118,32 @@ void tmc(uint64_t value)
   fputs("   ", stderr);
 }
 
+/* Types value as <symbol>+<offset> if it is in a symbol of j, else
+   as a number. */
+void outsym(struct job *j, uint64_t value)
+{
+  const char *name;
+  uint64_t off;
+
+  if (!(name = job_symbol(j, value, &off)))
+    {
+      outradix(value);
+      return;
+    }
+  fputs(name, stderr);
+  if (off)
+    {
+      fputc('+', stderr);
+      outradix(off);
+    }
+}
+
+void tms(uint64_t value)
+{
+  outsym(currjob, value);
+  fputs("   ", stderr);
+}
+
 union val {
   uint64_t i;
   double f;
@@ -1,4 +1,5 @@
 typedef void (typeoutfunc)(uint64_t);
+struct job;
 
 extern typeoutfunc *mdquot;
 extern typeoutfunc *mnmsgn;
@@ -14,3 +15,5 @@ void tmc(uint64_t value);
 void tmch(uint64_t value);
 void tmf(uint64_t value);
 void tmh(uint64_t value);
+void tms(uint64_t value);
+void outsym(struct job *j, uint64_t value);
@@ -0,0 +1,266 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "x86.h"
+
+/* Enough of the x86-64 instruction format to find how long an
+   instruction is and where its relative operands are, so that it can
+   be stepped over or moved elsewhere.  Only 64 bit mode. */
+
+#define M 0x01			/* ModRM follows */
+#define B 0x02			/* imm8 */
+#define Z 0x04			/* imm16 or imm32 by operand size */
+#define R 0x08			/* the immediate is a branch displacement */
+#define S 0x10			/* special, see insn_decode() */
+#define X 0x20			/* not valid in 64 bit mode */
+
+static const uint8_t onebyte[256] = {
+  /* 00 */ M, M, M, M, B, Z, X, X, M, M, M, M, B, Z, X, S,
+  /* 10 */ M, M, M, M, B, Z, X, X, M, M, M, M, B, Z, X, X,
+  /* 20 */ M, M, M, M, B, Z, S, X, M, M, M, M, B, Z, S, X,
+  /* 30 */ M, M, M, M, B, Z, S, X, M, M, M, M, B, Z, S, X,
+  /* 40 */ S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+  /* 50 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* 60 */ X, X, S, M, S, S, S, S, Z, M|Z, B, M|B, 0, 0, 0, 0,
+  /* 70 */ B|R, B|R, B|R, B|R, B|R, B|R, B|R, B|R,
+	   B|R, B|R, B|R, B|R, B|R, B|R, B|R, B|R,
+  /* 80 */ M|B, M|Z, X, M|B, M, M, M, M, M, M, M, M, M, M, M, M,
+  /* 90 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, X, 0, 0, 0, 0, 0,
+  /* A0 */ S, S, S, S, 0, 0, 0, 0, B, Z, 0, 0, 0, 0, 0, 0,
+  /* B0 */ B, B, B, B, B, B, B, B, S, S, S, S, S, S, S, S,
+  /* C0 */ M|B, M|B, S, 0, S, S, M|B, M|Z, S, 0, S, 0, 0, B, X, 0,
+  /* D0 */ M, M, M, M, X, X, X, 0, M, M, M, M, M, M, M, M,
+  /* E0 */ B|R, B|R, B|R, B|R, B, B, B, B, Z|R, Z|R, X, B|R, 0, 0, 0, 0,
+  /* F0 */ S, 0, S, S, 0, 0, S, S, 0, 0, 0, 0, 0, 0, M, M,
+};
+
+static const uint8_t twobyte[256] = {
+  /* 00 */ M, M, M, M, X, 0, 0, 0, 0, 0, X, 0, X, M, 0, M|B,
+  /* 10 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+  /* 20 */ M, M, M, M, X, X, X, X, M, M, M, M, M, M, M, M,
+  /* 30 */ 0, 0, 0, 0, 0, 0, X, 0, S, X, S, X, X, X, X, X,
+  /* 40 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+  /* 50 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+  /* 60 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+  /* 70 */ M|B, M|B, M|B, M|B, M, M, M, 0, M, M, X, X, M, M, M, M,
+  /* 80 */ Z|R, Z|R, Z|R, Z|R, Z|R, Z|R, Z|R, Z|R,
+	   Z|R, Z|R, Z|R, Z|R, Z|R, Z|R, Z|R, Z|R,
+  /* 90 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+  /* A0 */ 0, 0, 0, M, M|B, M, X, X, 0, 0, 0, M, M|B, M, M, M,
+  /* B0 */ M, M, M, M, M, M, M, M, M, M, M|B, M, M, M, M, M,
+  /* C0 */ M, M, M|B, M, M|B, M|B, M|B, M, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* D0 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+  /* E0 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+  /* F0 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+};
+
+static int legacy_prefix(uint8_t b)
+{
+  switch (b)
+    {
+    case 0x26: case 0x2e: case 0x36: case 0x3e: case 0x64: case 0x65:
+    case 0x66: case 0x67: case 0xf0: case 0xf2: case 0xf3:
+      return 1;
+    }
+  return 0;
+}
+
+/* Bytes taken by the ModRM byte at p and what it implies: SIB and
+   displacement.  0 if they do not fit in n. */
+static size_t modrm_length(const uint8_t *p, size_t n)
+{
+  size_t len = 1;
+  int mod = p[0] >> 6;
+  int rm = p[0] & 7;
+
+  if (mod != 3 && rm == 4)
+    {
+      if (n < 2)
+	return 0;
+      len++;
+      if (mod == 0 && (p[1] & 7) == 5)
+	len += 4;
+    }
+  if (mod == 0 && rm == 5)
+    len += 4;
+  else if (mod == 1)
+    len += 1;
+  else if (mod == 2)
+    len += 4;
+  return len <= n ? len : 0;
+}
+
+/* Decode the instruction in the n bytes at p.  Returns its length,
+   or 0 if it is not valid or does not fit. */
+int insn_decode(const uint8_t *p, size_t n, struct insn *in)
+{
+  size_t i = 0;
+  int opsize16 = 0, addr32 = 0, rexw = 0;
+  int f, imm = 0;
+
+  memset(in, 0, sizeof(*in));
+  in->modrm = in->disp = in->rel = -1;
+
+  while (i < n && legacy_prefix(p[i]))
+    {
+      if (p[i] == 0x66)
+	opsize16 = 1;
+      else if (p[i] == 0x67)
+	addr32 = 1;
+      i++;
+    }
+  if (i < n && (p[i] & 0xf0) == 0x40)
+    rexw = p[i++] & 8;
+  if (i >= n)
+    return 0;
+
+  if (p[i] == 0xc4 || p[i] == 0xc5 || p[i] == 0x62)
+    {
+      /* VEX and EVEX: the map comes from the prefix and a ModRM
+	 always follows, except for vzeroupper and vzeroall. */
+      int evex = p[i] == 0x62;
+      size_t plen = p[i] == 0xc5 ? 2 : evex ? 4 : 3;
+      if (i + plen >= n)
+	return 0;
+      in->map = p[i] == 0xc5 ? 1 : p[i + 1] & (evex ? 7 : 0x1f);
+      i += plen;
+      in->op = p[i++];
+      if (in->map == 1)
+	{
+	  f = twobyte[in->op] & (M | B);
+	  if (in->op == 0x77 && !evex)
+	    f = 0;
+	}
+      else if (in->map == 3)
+	f = M | B;
+      else
+	f = M;
+      in->op |= in->map << 8;
+    }
+  else if (p[i] == 0x0f)
+    {
+      if (++i >= n)
+	return 0;
+      if (p[i] == 0x38 || p[i] == 0x3a)
+	{
+	  in->map = p[i] == 0x38 ? 2 : 3;
+	  if (++i >= n)
+	    return 0;
+	  f = in->map == 3 ? M | B : M;
+	}
+      else
+	{
+	  in->map = 1;
+	  f = twobyte[p[i]];
+	}
+      in->op = in->map << 8 | p[i++];
+      if (f & X)
+	return 0;
+      if ((in->op & 0xfff0) == 0x0180)
+	in->flags = INSN_JCC;
+    }
+  else
+    {
+      in->op = p[i++];
+      f = onebyte[in->op];
+      if (f & X)
+	return 0;
+      if (f & S)
+	switch (in->op)
+	  {
+	  case 0xa0: case 0xa1: case 0xa2: case 0xa3:	/* mov moffs */
+	    imm = addr32 ? 4 : 8;
+	    f = 0;
+	    break;
+	  case 0xb8: case 0xb9: case 0xba: case 0xbb:	/* mov imm64 */
+	  case 0xbc: case 0xbd: case 0xbe: case 0xbf:
+	    imm = rexw ? 8 : opsize16 ? 2 : 4;
+	    f = 0;
+	    break;
+	  case 0xc2: case 0xca:				/* ret imm16 */
+	    imm = 2;
+	    f = 0;
+	    break;
+	  case 0xc8:					/* enter */
+	    imm = 3;
+	    f = 0;
+	    break;
+	  case 0xf6: case 0xf7:				/* test imm is /0 */
+	    if (i >= n)
+	      return 0;
+	    f = M;
+	    if (((p[i] >> 3) & 7) < 2)
+	      f |= in->op == 0xf6 ? B : Z;
+	    break;
+	  default:					/* stray prefix */
+	    return 0;
+	  }
+      switch (in->op)
+	{
+	case 0xe8:
+	  in->flags = INSN_CALL;
+	  break;
+	case 0xe9: case 0xeb:
+	  in->flags = INSN_JMP;
+	  break;
+	default:
+	  if (f & R)
+	    in->flags = INSN_JCC;
+	}
+    }
+
+  if (f & M)
+    {
+      size_t m;
+      if (i >= n || !(m = modrm_length(p + i, n - i)))
+	return 0;
+      in->modrm = i;
+      if ((p[i] & 0xc7) == 0x05)
+	in->disp = i + 1;
+      if (in->op == 0xff && ((p[i] >> 3) & 7) >= 2 && ((p[i] >> 3) & 7) <= 3)
+	in->flags = INSN_CALL;
+      i += m;
+    }
+  if (f & B)
+    imm = 1;
+  else if (f & Z)
+    imm = opsize16 && !(f & R) ? 2 : 4;
+  if (f & R)
+    {
+      in->rel = i;
+      in->relsize = imm;
+    }
+  i += imm;
+  if (i > n)
+    return 0;
+  return in->len = i;
+}
+
+/* Length of the instruction at p if it is a call, else 0.  p holds
+   n bytes. */
+int call_length(const uint8_t *p, size_t n)
+{
+  struct insn in;
+
+  if (insn_decode(p, n, &in) && (in.flags & INSN_CALL))
+    return in.len;
+  return 0;
+}
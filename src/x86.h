@@ -0,0 +1,35 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+This file is part of Linux-ddt.
+
+Linux-ddt is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+Linux-ddt is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Linux-ddt. If not, see <https://www.gnu.org/licenses/>.
+*/
+struct insn {
+  int len;
+  int op;			/* opcode byte, plus map << 8 */
+  int map;			/* 0 one byte, 1 0F, 2 0F38, 3 0F3A */
+  int modrm;			/* offset of the ModRM byte, -1 if none */
+  int disp;			/* offset of a rip-relative disp32, -1 if none */
+  int rel;			/* offset of a branch displacement, -1 if none */
+  int relsize;			/* its size, 1 or 4 */
+  int flags;
+};
+
+#define INSN_CALL 1
+#define INSN_JMP 2		/* unconditional jmp */
+#define INSN_JCC 4		/* conditional branch, loop, jrcxz */
+
+int insn_decode(const uint8_t *p, size_t n, struct insn *in);
+int call_length(const uint8_t *p, size_t n);